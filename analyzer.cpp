@@ -1,13 +1,39 @@
 #include "analyzer.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 
+#include "thread_pool.h"
+
+namespace {
+
+// Thrown by TypeChecker::Error() in a checker that does not exit on errors.
+struct SemanticError {};
+
+// Of a variable bound with `kind`.
+VarScope ScopeOf(SymbolKind kind) {
+    switch (kind) {
+    case kParamSymbol:
+        return kParam;
+    case kGlobalSymbol:
+        return kGlobal;
+    default:
+        return kLocal;
+    }
+}
+
+} // namespace
+
 TypeChecker::TypeChecker(const std::string &filename) : filename_(filename) {
-    EnterScope();
     CreateAllBuiltinFunctions();
 }
 
+TypeChecker::TypeChecker(WorkerTag, const TypeChecker &parent)
+    : filename_(parent.filename_), source_(parent.source_),
+      global_scope_(&parent.symbols_), exit_on_error_(false) {
+}
+
 void TypeChecker::CreateAllBuiltinFunctions() {
     CreateBuiltinFunction("getint", kInt, {});
     CreateBuiltinFunction("getdouble", kDouble, {});
@@ -19,252 +45,693 @@ void TypeChecker::CreateAllBuiltinFunctions() {
     CreateBuiltinFunction("putln", kVoid, {});
 }
 
-void TypeChecker::CreateBuiltinFunction(std::string func_name, VarType return_type, std::vector<VarType> params) {
-    Ptr<FuncDefNode> func = std::make_unique<FuncDefNode>();
-    func->name = std::move(func_name);
+void TypeChecker::CreateBuiltinFunction(std::string_view func_name, VarType return_type, std::vector<VarType> params) {
+    FuncDefNode *func = builtin_arena_.New<FuncDefNode>();
+    func->name = Interner::Global().Intern(func_name);
     func->return_type = return_type;
 
-    for (VarType param : params) {
-        Ptr<DeclStmtNode> p = std::make_unique<DeclStmtNode>();
-        p->type = param;
-        func->params.push_back(std::move(p));
+    func->params = builtin_arena_.NewArray<DeclStmtNode *>(params.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+        func->params[i] = builtin_arena_.New<DeclStmtNode>();
+        func->params[i]->type = params[i];
     }
 
-    SymTab().InsertSymbol(func->name, func.get());
-    builtin_funcs_.push_back(std::move(func));
+    symbols_.InsertSymbol(func->name, kFunctionSymbol, func);
+    builtin_funcs_.push_back(func);
 }
 
 
 void TypeChecker::Visit(ProgramNode *node) {
-    // Add all functions to the symbol table.
-    for (const auto &fn : node->functions) {
-        if (!SymTab().InsertSymbol(fn->name, fn.get())) {
-            error_ << "Redeclare function " << fn->name;
-            Error(fn->pos);
-        }
-    }
+    DeclareFunctions(node->source, node->functions);
 
     for (const auto &var : node->global_vars) {
-        var->Accept(*this);
+        Walk(var);
+    }
+
+    if (num_threads_ > 1) {
+        CheckFunctionsParallel(node->functions);
+        return;
     }
 
     for (const auto &fn : node->functions) {
-        fn->Accept(*this);
+        Walk(fn);
+    }
+}
+
+// Once the functions and globals are declared, a function only changes its
+// own nodes and scopes, so functions can be checked at the same time. They
+// are checked in chunks of consecutive functions by workers that share the
+// global scope. A worker stops at the first error instead of exiting, and
+// the error of the first function in source order that has one is reported,
+// as a serial check would.
+void TypeChecker::CheckFunctionsParallel(Span<FuncDefNode *> functions) {
+    const size_t num_chunks = std::min<size_t>(functions.size(), num_threads_ * 4);
+    if (num_chunks == 0)
+        return;
+
+    struct Chunk {
+        explicit Chunk(const TypeChecker &parent) : checker(WorkerTag(), parent) {}
+
+        TypeChecker checker;
+        size_t first = 0;
+        size_t last = 0;
+        size_t failed = 0;      // The first function with an error, or last.
+    };
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    ThreadPool pool(std::min<size_t>(num_threads_, num_chunks));
+    for (size_t i = 0; i < num_chunks; ++i) {
+        chunks.push_back(std::make_unique<Chunk>(*this));
+        Chunk *chunk = chunks.back().get();
+        chunk->first = functions.size() * i / num_chunks;
+        chunk->last = functions.size() * (i + 1) / num_chunks;
+        chunk->failed = chunk->last;
+
+        pool.Submit([chunk, functions] {
+            for (size_t fn = chunk->first; fn < chunk->last; ++fn) {
+                if (!chunk->checker.CheckFunction(functions[fn])) {
+                    chunk->failed = fn;
+                    return;
+                }
+            }
+        });
+    }
+    pool.Wait();
+
+    for (const auto &chunk : chunks) {
+        if (chunk->failed < chunk->last)
+            ReportError(chunk->checker);
+    }
+}
+
+bool TypeChecker::CheckFunction(FuncDefNode *func) {
+    try {
+        Walk(func);
+    } catch (const SemanticError &) {
+        return false;
+    }
+    return true;
+}
+
+void TypeChecker::ReportError(const TypeChecker &worker) {
+    error_ << worker.error_message_;
+    Error(worker.error_pos_);
+}
+
+void TypeChecker::DeclareFunctions(const std::shared_ptr<SourceBuffer> &source,
+                                   Span<FuncDefNode *> functions) {
+    source_ = source;
+
+    // Add all functions to the symbol table.
+    for (const auto &fn : functions) {
+        Declare(fn->name, kFunctionSymbol, fn, fn->pos);
     }
 }
 
 void TypeChecker::Visit(ExprStmtNode *node) {
-    node->expr->Accept(*this);
+    Walk(node->expr);
 }
 
 void TypeChecker::Visit(DeclStmtNode *node) {
-    if (!SymTab().InsertSymbol(node->name, node)) {
-        error_ << "Redeclaration of symbol " << node->name;
-        Error(node->pos);
+    Declare(node->name, func_ ? kVariableSymbol : kGlobalSymbol, node, node->pos);
+
+    // Every local gets a slot of its own, also one that shadows another.
+    if (func_) {
+        node->scope = kLocal;
+        node->slot = func_->num_locals++;
+    } else {
+        node->scope = kGlobal;
+        node->slot = num_globals_++;
     }
 
     if (node->initializer) {
-        node->initializer->Accept(*this);
-        if (node->type != node->initializer->type.type) {
-            error_ << "Cannot assign expresion of type "
-                   << TypeToString(node->initializer->type.type)
-                   << " to variable "
-                   << node->name
-                   << " which has type "
-                   << TypeToString(node->type);
-            Error(node->initializer->pos);
-        }
+        Walk(node->initializer);
+        CheckInitializer(node->name, node->type, node->initializer->type.type, node->initializer->pos);
     }
 }
 
 void TypeChecker::Visit(IfStmtNode *node) {
-    node->if_part.condition->Accept(*this);
-    node->if_part.body->Accept(*this);
+    Walk(node->if_part.condition);
+    Walk(node->if_part.body);
 
     for (const auto &cond_body : node->elif_part) {
-        cond_body.condition->Accept(*this);
-        cond_body.body->Accept(*this);
+        Walk(cond_body.condition);
+        Walk(cond_body.body);
     }
 
     if (node->else_part)
-        node->else_part->Accept(*this);
+        Walk(node->else_part);
 }
 
 void TypeChecker::Visit(WhileStmtNode *node) {
-    node->condition->Accept(*this);
-    node->body->Accept(*this);
+    Walk(node->condition);
+    Walk(node->body);
 }
 
 void TypeChecker::Visit(ReturnStmtNode *node) {
-    VarType return_type = node->func->return_type;
-    if (return_type == kVoid) {
-        if (node->expr) {
-            error_ << "Return non empty expression in function "
-                   << node->func->name
-                   << " that returns void";
-            Error(node->pos);
-        }
-        return;
-    }
-
-    node->expr->Accept(*this);
-    if (return_type != node->expr->type.type) {
-        error_ << "Return type mismatch in function "
-               << node->func->name;
-        Error(node->pos);
+    const FuncDefNode *func = node->func;
+    VarType type = kVoid;
+    if (func->return_type != kVoid && node->expr) {
+        Walk(node->expr);
+        type = node->expr->type.type;
     }
+    CheckReturn(func->name, func->return_type, node->expr != nullptr, type, node->pos);
 }
 
 void TypeChecker::Visit(BlockStmtNode *node) {
     if (!node->is_func_body)
         EnterScope();
     for (const auto &stmt : node->statements) {
-        stmt->Accept(*this);
+        Walk(stmt);
     }
     if (!node->is_func_body)
         LeaveScope();
 }
 
 void TypeChecker::Visit(OperatorExprNode *node) {
-    node->left->Accept(*this);
-    node->right->Accept(*this);
-    VarType left_type = node->left->type.type;
-    VarType right_type = node->right->type.type;
+    CheckExpr(node);
+}
 
-    if (left_type != right_type || left_type == kVoid || left_type == kBool) {
-        error_ << "The type of both operands of an binary operator '"
-               << TokenToString(node->op)
-               << "' must be the same and cannot be void or bool.";
-        Error(node->pos);
+void TypeChecker::Visit(NegateExpr *node) {
+    CheckExpr(node);
+}
+
+void TypeChecker::Visit(AssignExprNode *node) {
+    CheckExpr(node);
+}
+
+void TypeChecker::Visit(CallExprNode *node) {
+    CheckExpr(node);
+}
+
+void TypeChecker::Visit(LiteralExprNode *) {
+}
+
+void TypeChecker::Visit(IdentExprNode *node) {
+    CheckExpr(node);
+}
+
+// Expressions are checked with expr_stack_ instead of recursion, as deep as
+// the parser accepts them. A node is checked in steps, each returning the
+// next child to check or nullptr once the node is done. Diagnostics come in
+// the same order as from a recursive walk.
+void TypeChecker::CheckExpr(ExprNode *root) {
+    const size_t base = expr_stack_.size();
+    expr_stack_.push_back({root, 0, nullptr});
+
+    while (expr_stack_.size() > base) {
+        ExprFrame &frame = expr_stack_.back();
+        ExprNode *child = nullptr;
+
+        switch (frame.node->kind) {
+        case kOperatorExprNode:
+            child = CheckStep(static_cast<OperatorExprNode *>(frame.node), frame);
+            break;
+        case kNegateExpr:
+            child = CheckStep(static_cast<NegateExpr *>(frame.node), frame);
+            break;
+        case kAssignExprNode:
+            child = CheckStep(static_cast<AssignExprNode *>(frame.node), frame);
+            break;
+        case kCallExprNode:
+            child = CheckStep(static_cast<CallExprNode *>(frame.node), frame);
+            break;
+        case kIdentExprNode:
+            CheckStep(static_cast<IdentExprNode *>(frame.node));
+            break;
+        default:
+            break;
+        }
+
+        if (child == nullptr) {
+            expr_stack_.pop_back();
+        } else {
+            ++frame.next_child;
+            expr_stack_.push_back({child, 0, nullptr});
+        }
+    }
+}
+
+ExprNode *TypeChecker::CheckStep(OperatorExprNode *node, ExprFrame &frame) {
+    if (frame.next_child == 0)
+        return node->left;
+    if (frame.next_child == 1)
+        return node->right;
+
+    node->type.type = CheckOperator(node->op, node->left->type.type, node->right->type.type, node->pos);
+    return nullptr;
+}
+
+ExprNode *TypeChecker::CheckStep(NegateExpr *node, ExprFrame &frame) {
+    if (frame.next_child == 0)
+        return node->operand;
+
+    node->type.type = CheckNegate(node->operand->type.type, node->pos);
+    return nullptr;
+}
+
+ExprNode *TypeChecker::CheckStep(AssignExprNode *node, ExprFrame &frame) {
+    if (frame.next_child == 0) {
+        node->decl = LookUpAssigned<DeclStmtNode>(node->lhs, node->pos);
+        return node->rhs;
+    }
+
+    CheckAssign(node->lhs, node->decl->type, node->rhs->type.type, node->rhs->pos);
+
+    // Assignment expression has void type.
+    node->type.type = kVoid;
+    return nullptr;
+}
+
+// Argument i is checked in step i + 1.
+ExprNode *TypeChecker::CheckStep(CallExprNode *node, ExprFrame &frame) {
+    const uint32_t i = frame.next_child;
+    if (i == 0) {
+        FuncDefNode *func = LookUpFunction<FuncDefNode>(node->func_name, node->pos);
+        CheckNumArgs(node->func_name, func->params.size(), node->args.size(), node->pos);
+        frame.decl = func;
+    }
+
+    auto func = static_cast<FuncDefNode *>(frame.decl);
+    if (i > 0)
+        CheckArg(func->name, func->params[i - 1]->type, node->args[i - 1]->type.type, node->args[i - 1]->pos);
+
+    if (i < node->args.size())
+        return node->args[i];
+
+    node->type.type = func->return_type;
+    node->func = func;
+    return nullptr;
+}
+
+void TypeChecker::CheckStep(IdentExprNode *node) {
+    DeclStmtNode *var = LookUpVariable<DeclStmtNode>(node->var_name, node->pos);
+    node->decl = var;
+    node->type.type = var->type;
+}
+
+void TypeChecker::Visit(FuncDefNode *node) {
+    EnterScope();
+    // Insert parameters to the symbol table.
+    for (size_t i = 0; i < node->params.size(); ++i) {
+        DeclStmtNode *param = node->params[i];
+        Declare(param->name, kParamSymbol, param, param->pos);
+        param->scope = kParam;
+        param->slot = i;
+    }
+
+    func_ = node;
+    node->num_locals = 0;
+    Walk(node->body);
+    func_ = nullptr;
+
+    LeaveScope();
+}
+
+void TypeChecker::Check(FlatAst &ast) {
+    flat_ = &ast;
+    source_ = ast.source;
+
+    // Names are bound to the records of `ast`, in a scope of their own that
+    // shadows the builtin functions bound to nodes. Those are bound again to
+    // records, with their parameters after those of the program.
+    EnterScope();
+    flat_builtins_.clear();
+    for (FuncDefNode *func : builtin_funcs_) {
+        FlatFunc fn = {};
+        fn.name = func->name;
+        fn.return_type = func->return_type;
+        fn.first_param = ast.params.size();
+        fn.num_params = func->params.size();
+        for (const auto &param : func->params) {
+            FlatStmt p = {};
+            p.kind = kFlatDecl;
+            p.type = param->type;
+            ast.params.push_back(p);
+        }
+        flat_builtins_.push_back(fn);
+    }
+    for (FlatFunc &fn : flat_builtins_) {
+        symbols_.InsertSymbol(fn.name, kFunctionSymbol, &fn);
+    }
+
+    // Add all functions to the symbol table.
+    for (FlatFunc &fn : ast.functions) {
+        Declare(fn.name, kFunctionSymbol, &fn, fn.pos);
+    }
+
+    for (uint32_t i = 0; i < ast.globals.size(); ++i) {
+        CheckDecl(ast.globals[i], kGlobalSymbol, i);
+    }
+
+    for (FlatFunc &fn : ast.functions) {
+        EnterScope();
+        for (uint32_t i = 0; i < fn.num_params; ++i) {
+            FlatStmt &param = ast.params[fn.first_param + i];
+            Declare(param.a, kParamSymbol, &param, param.pos);
+            param.a = i;
+        }
+
+        fn.num_locals = 0;
+        CheckStmt(fn.body, fn);
+        LeaveScope();
+    }
+
+    LeaveScope();
+    flat_ = nullptr;
+}
+
+// Like Visit(DeclStmtNode *), the name of the variable is replaced by its
+// slot, which is what lookups of the variable read from then on.
+void TypeChecker::CheckDecl(FlatStmt &decl, SymbolKind kind, uint32_t slot) {
+    const Symbol name = decl.a;
+    Declare(name, kind, &decl, decl.pos);
+    decl.a = slot;
+
+    if (decl.b != kFlatNone) {
+        CheckExpr(decl.b);
+        const FlatExpr &init = flat_->exprs[decl.b];
+        CheckInitializer(name, VarType(decl.type), VarType(init.type), init.pos);
     }
+}
 
-    switch (node->op) {
-    case kMul:
-    case kDiv:
-    case kMinus:
-    case kPlus:
-        node->type.type = left_type;
+void TypeChecker::CheckStmt(uint32_t index, FlatFunc &func) {
+    FlatStmt &stmt = flat_->stmts[index];
+
+    switch (stmt.kind) {
+    case kFlatDecl:
+        // Every local gets a slot of its own, also one that shadows another.
+        CheckDecl(stmt, kVariableSymbol, func.num_locals++);
         break;
-    case kGt:
-    case kLt:
-    case kGe:
-    case kLe:
-    case kEq:
-    case kNeq:
-        node->type.type = kBool;
+    case kFlatExprStmt:
+        CheckExpr(stmt.a);
+        break;
+    case kFlatReturn: {
+        VarType type = kVoid;
+        if (func.return_type != kVoid && stmt.a != kFlatNone) {
+            CheckExpr(stmt.a);
+            type = VarType(flat_->exprs[stmt.a].type);
+        }
+        CheckReturn(func.name, func.return_type, stmt.a != kFlatNone, type, stmt.pos);
+        break;
+    }
+    case kFlatBlock:
+        if (!stmt.is_func_body)
+            EnterScope();
+        for (uint32_t i = index + 1; i < stmt.b; i = flat_->End(i)) {
+            CheckStmt(i, func);
+        }
+        if (!stmt.is_func_body)
+            LeaveScope();
+        break;
+    case kFlatIf:
+    case kFlatWhile:
+        CheckExpr(stmt.a);
+        for (uint32_t i = index + 1; i < stmt.b; i = flat_->End(i)) {
+            const FlatStmt &part = flat_->stmts[i];
+            if (part.kind == kFlatElseIf) {
+                CheckExpr(part.a);
+                CheckStmt(i + 1, func);
+            } else {
+                CheckStmt(i, func);
+            }
+        }
+        break;
+    case kFlatElseIf:
+        break;
+    }
+}
+
+// Like CheckExpr(ExprNode *), with steps that return kFlatNone once the
+// expression is done.
+void TypeChecker::CheckExpr(uint32_t root) {
+    const size_t base = flat_expr_stack_.size();
+    flat_expr_stack_.push_back({root, 0, 0});
+
+    while (flat_expr_stack_.size() > base) {
+        FlatExprFrame &frame = flat_expr_stack_.back();
+        const uint32_t child = CheckStep(frame);
+
+        if (child == kFlatNone) {
+            flat_expr_stack_.pop_back();
+        } else {
+            ++frame.next_child;
+            flat_expr_stack_.push_back({child, 0, 0});
+        }
+    }
+}
+
+uint32_t TypeChecker::CheckStep(FlatExprFrame &frame) {
+    const uint32_t index = frame.expr;
+    FlatExpr &expr = flat_->exprs[index];
+
+    switch (expr.kind) {
+    case kFlatIntLiteral:
+    case kFlatDoubleLiteral:
+        break;
+    case kFlatIdent: {
+        SymbolKind kind = kVariableSymbol;
+        const FlatStmt *var = LookUpVariable<FlatStmt>(expr.value, expr.pos, &kind);
+        expr.type = var->type;
+        expr.op = ScopeOf(kind);
+        expr.value = var->a;
+        break;
+    }
+    case kFlatAssign: {
+        if (frame.next_child == 0) {
+            LookUpAssigned<FlatStmt>(expr.value, expr.pos);
+            return index - 1;
+        }
+
+        SymbolKind kind = kVariableSymbol;
+        const FlatStmt *var = LookUp<FlatStmt>(expr.value, &kind);
+        const FlatExpr &rhs = flat_->exprs[index - 1];
+        CheckAssign(expr.value, VarType(var->type), VarType(rhs.type), rhs.pos);
+
+        // Assignment expression has void type.
+        expr.type = kVoid;
+        expr.op = ScopeOf(kind);
+        expr.value = var->a;
+        break;
+    }
+    case kFlatNegate: {
+        if (frame.next_child == 0)
+            return index - 1;
+
+        expr.type = CheckNegate(VarType(flat_->exprs[index - 1].type), expr.pos);
+        break;
+    }
+    case kFlatOperator: {
+        const uint32_t right = index - 1;
+        const uint32_t left = flat_->Previous(right);
+        if (frame.next_child == 0)
+            return left;
+        if (frame.next_child == 1)
+            return right;
+
+        expr.type = CheckOperator(TokenType(expr.op), VarType(flat_->exprs[left].type),
+                                  VarType(flat_->exprs[right].type), expr.pos);
+        break;
+    }
+    case kFlatCall: {
+        const FlatFunc *func = LookUpFunction<FlatFunc>(expr.value, expr.pos);
+        if (frame.next_child == 0) {
+            // The arguments end right before the call, collect their roots
+            // going backwards. Those of the calls among them go on top and
+            // are gone again by the time they are checked.
+            frame.first_arg = arg_stack_.size();
+            for (uint32_t end = index; end > expr.first; end = flat_->exprs[end - 1].first) {
+                arg_stack_.push_back(end - 1);
+            }
+            std::reverse(arg_stack_.begin() + frame.first_arg, arg_stack_.end());
+
+            CheckNumArgs(expr.value, func->num_params, arg_stack_.size() - frame.first_arg, expr.pos);
+        } else {
+            // The argument checked in the previous step.
+            const uint32_t i = frame.next_child - 1;
+            const FlatExpr &arg_expr = flat_->exprs[arg_stack_[frame.first_arg + i]];
+            const FlatStmt &param = flat_->params[func->first_param + i];
+            CheckArg(expr.value, VarType(param.type), VarType(arg_expr.type), arg_expr.pos);
+        }
+
+        if (frame.first_arg + frame.next_child < arg_stack_.size())
+            return arg_stack_[frame.first_arg + frame.next_child];
+
+        arg_stack_.resize(frame.first_arg);
+        expr.type = func->return_type;
+        break;
+    }
+    }
+    return kFlatNone;
+}
+
+void TypeChecker::Declare(Symbol name, SymbolKind kind, void *target, Position pos) {
+    if (symbols_.InsertSymbol(name, kind, target))
+        return;
+
+    switch (kind) {
+    case kFunctionSymbol:
+        error_ << "Redeclare function " << SymbolName(name);
+        break;
+    case kParamSymbol:
+        error_ << "Duplicated parameter name " << SymbolName(name);
         break;
     default:
+        error_ << "Redeclaration of symbol " << SymbolName(name);
         break;
     }
+    Error(pos);
 }
 
-void TypeChecker::Visit(NegateExpr *node) {
-    node->operand->Accept(*this);
-    VarType operand_type = node->operand->type.type;
-    if (operand_type == kVoid || operand_type == kBool) {
-        error_ << "The operand of '-' cannot be of type void or bool";
-        Error(node->pos);
+template <typename T>
+T *TypeChecker::LookUpVariable(Symbol name, Position pos, SymbolKind *kind) {
+    T *var = LookUp<T>(name, kind);
+    if (var == nullptr) {
+        // Reference to an undeclared variable.
+        error_ << "Undeclared variable " << SymbolName(name);
+        Error(pos);
     }
-    node->type.type = node->operand->type.type;
+    return var;
 }
 
-void TypeChecker::Visit(AssignExprNode *node) {
-    DeclStmtNode *var = LookUp<DeclStmtNode>(node->lhs);
+template <typename T>
+T *TypeChecker::LookUpAssigned(Symbol name, Position pos) {
+    T *var = LookUp<T>(name);
     if (var == nullptr) {
         // Assign to an undeclared variable.
         error_ << "Cannot assign to an undefined variable "
-               << node->lhs;
-        Error(node->pos);
+               << SymbolName(name);
+        Error(pos);
     }
 
     if (var->is_const) {
         // Assign to a const variable.
         error_ << "Cannot assign to const variable "
-               << node->lhs;
-        Error(node->pos);
+               << SymbolName(name);
+        Error(pos);
     }
+    return var;
+}
 
-    node->rhs->Accept(*this);
-    if (var->type != node->rhs->type.type) {
-        error_ << "Cannot assign expression of type "
-               << TypeToString(node->rhs->type.type)
-               << " to the variable " << node->lhs
-               << " which has type " + TypeToString(var->type);
-        Error(node->rhs->pos);
+template <typename T>
+T *TypeChecker::LookUpFunction(Symbol name, Position pos) {
+    T *func = LookUp<T>(name);
+    if (func == nullptr) {
+        error_ << "Undefined function " << SymbolName(name);
+        Error(pos);
     }
-
-    // Assignment expression has void type.
-    node->type.type = kVoid;
+    return func;
 }
 
-void TypeChecker::Visit(CallExprNode *node) {
-    FuncDefNode *func = LookUp<FuncDefNode>(node->func_name);
-    if (func == nullptr) {
-        error_ << "Undefined function " << node->func_name;
-        Error(node->pos);
+void TypeChecker::CheckInitializer(Symbol name, VarType type, VarType init_type, Position init_pos) {
+    if (type != init_type) {
+        error_ << "Cannot assign expresion of type "
+               << TypeToString(init_type)
+               << " to variable "
+               << SymbolName(name)
+               << " which has type "
+               << TypeToString(type);
+        Error(init_pos);
     }
+}
 
-    if (func->params.size() != node->args.size()) {
-        error_ << "Parameter size mismatch when calling function "
-               << node->func_name;
-        Error(node->pos);
-    }
-
-    for (int i = 0; i < func->params.size(); ++i) {
-        node->args[i]->Accept(*this);
-        if (func->params[i]->type != node->args[i]->type.type) {
-            error_ << "Type mismatch, expected "
-                   << TypeToString(func->params[i]->type)
-                   << ", got " << TypeToString(node->args[i]->type.type)
-                   << " when calling function " << func->name;
-            Error(node->args[i]->pos);
+// The returned value, if any, is only checked in a function that returns
+// one, and `type` is kVoid without it.
+void TypeChecker::CheckReturn(Symbol func_name, VarType return_type, bool has_value, VarType type, Position pos) {
+    if (return_type == kVoid) {
+        if (has_value) {
+            error_ << "Return non empty expression in function "
+                   << SymbolName(func_name)
+                   << " that returns void";
+            Error(pos);
         }
+        return;
     }
 
-    node->type.type = func->return_type;
+    if (return_type != type) {
+        error_ << "Return type mismatch in function "
+               << SymbolName(func_name);
+        Error(pos);
+    }
 }
 
-void TypeChecker::Visit(LiteralExprNode *node) {
+void TypeChecker::CheckAssign(Symbol name, VarType type, VarType rhs_type, Position rhs_pos) {
+    if (type != rhs_type) {
+        error_ << "Cannot assign expression of type "
+               << TypeToString(rhs_type)
+               << " to the variable " << SymbolName(name)
+               << " which has type " << TypeToString(type);
+        Error(rhs_pos);
+    }
 }
 
-void TypeChecker::Visit(IdentExprNode *node) {
-    DeclStmtNode *var = LookUp<DeclStmtNode>(node->var_name);
-    if (var == nullptr) {
-        // Reference to an undeclared variable.
-        error_ << "Undeclared variable " << node->var_name;
-        Error(node->pos);
+VarType TypeChecker::CheckNegate(VarType operand_type, Position pos) {
+    if (operand_type == kVoid || operand_type == kBool) {
+        error_ << "The operand of '-' cannot be of type void or bool";
+        Error(pos);
     }
-
-    node->type.type = var->type;
+    return operand_type;
 }
 
-void TypeChecker::Visit(FuncDefNode *node) {
-    EnterScope();
-    // Insert parameters to the symbol table.
-    for (const auto &param : node->params) {
-        if (!SymTab().InsertSymbol(param->name, param.get())) {
-            error_ << "Duplicated parameter name " << param->name;
-            Error(param->pos);
-        }
+VarType TypeChecker::CheckOperator(TokenType op, VarType left_type, VarType right_type, Position pos) {
+    if (left_type != right_type || left_type == kVoid || left_type == kBool) {
+        error_ << "The type of both operands of an binary operator '"
+               << TokenToString(op)
+               << "' must be the same and cannot be void or bool.";
+        Error(pos);
+    }
+
+    switch (op) {
+    case kGt:
+    case kLt:
+    case kGe:
+    case kLe:
+    case kEq:
+    case kNeq:
+        return kBool;
+    default:
+        return left_type;
     }
+}
 
-    node->body->Accept(*this);
+void TypeChecker::CheckNumArgs(Symbol func_name, size_t num_params, size_t num_args, Position pos) {
+    if (num_params != num_args) {
+        error_ << "Parameter size mismatch when calling function "
+               << SymbolName(func_name);
+        Error(pos);
+    }
+}
 
-    LeaveScope();
+void TypeChecker::CheckArg(Symbol func_name, VarType param_type, VarType arg_type, Position arg_pos) {
+    if (param_type != arg_type) {
+        error_ << "Type mismatch, expected "
+               << TypeToString(param_type)
+               << ", got " << TypeToString(arg_type)
+               << " when calling function " << SymbolName(func_name);
+        Error(arg_pos);
+    }
 }
 
 void TypeChecker::Error(Position error_pos) {
+    if (!exit_on_error_) {
+        error_pos_ = error_pos;
+        error_message_ = error_.str();
+        throw SemanticError();
+    }
+
+    if (parser_)
+        parser_->SkipRest();
+
     std::cout << filename_ << ":"
-              << error_pos.LineNo() << ":"
-              << error_pos.ColNo()
+              << source_->LineNo(error_pos) << ":"
+              << source_->ColNo(error_pos)
               << ": semantic error: " << error_.str() << std::endl;
     exit(1);
 }
 
 void TypeChecker::EnterScope() {
-    symbol_tables_.emplace_back();
+    symbols_.EnterScope();
 }
 
 void TypeChecker::LeaveScope() {
-    symbol_tables_.pop_back();
+    symbols_.LeaveScope();
 }
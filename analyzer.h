@@ -2,17 +2,21 @@
 #define ANALYZER_H
 
 #include <string>
-#include <unordered_map>
+#include <type_traits>
 #include <vector>
 #include <sstream>
 
 #include "ast.h"
+#include "flat_ast.h"
 #include "parser.h"
 #include "symbol_table.h"
 
-class TypeChecker : public AstVisitor {
+class TypeChecker final : public AstVisitor, public AstWalker<TypeChecker> {
 public:
     TypeChecker(const std::string &filename);
+    TypeChecker(const TypeChecker &) = delete;
+    TypeChecker &operator=(const TypeChecker &) = delete;
+
     void Visit(ProgramNode *node) override;
     void Visit(ExprStmtNode *node) override;
     void Visit(DeclStmtNode *node) override;
@@ -28,33 +32,123 @@ public:
     void Visit(IdentExprNode *node) override;
     void Visit(FuncDefNode *node) override;
 
+    // Check a program part by part while it is parsed: DeclareFunctions()
+    // first, then Walk() each global variable and function in order.
+    void DeclareFunctions(const std::shared_ptr<SourceBuffer> &source, Span<FuncDefNode *> functions);
+
+    // Let `parser` finish the file before a semantic error is reported, so
+    // that syntax errors come first as if the file had been parsed already.
+    void SetParser(Parser *parser) { parser_ = parser; }
+
+    // Check the functions of a ProgramNode on this many threads.
+    void SetThreads(unsigned num_threads) { num_threads_ = num_threads; }
+
+    // Check a flattened program, filling in the types of its expressions.
+    void Check(FlatAst &ast);
+
 private:
+    friend class Pipeline;
+
+    // Picks the constructor of a worker, which is no copy of its parent.
+    struct WorkerTag {};
+
+    // A checker for CheckFunctionsParallel() and the Pipeline that looks
+    // names up in the global scope of `parent` after its own scopes.
+    TypeChecker(WorkerTag, const TypeChecker &parent);
+
+    void CheckFunctionsParallel(Span<FuncDefNode *> functions);
+
+    // Check a function in a worker, returning false on an error, which its
+    // parent reports with ReportError(). The worker cannot be used again.
+    bool CheckFunction(FuncDefNode *func);
+    void ReportError(const TypeChecker &worker);
+
+    // An expression being checked by CheckExpr().
+    struct ExprFrame {
+        ExprNode *node;
+        uint32_t next_child;        // Number of steps done.
+        Node *decl;                 // The function a call refers to.
+    };
+
+    void CheckExpr(ExprNode *root);
+    ExprNode *CheckStep(OperatorExprNode *node, ExprFrame &frame);
+    ExprNode *CheckStep(NegateExpr *node, ExprFrame &frame);
+    ExprNode *CheckStep(AssignExprNode *node, ExprFrame &frame);
+    ExprNode *CheckStep(CallExprNode *node, ExprFrame &frame);
+    void CheckStep(IdentExprNode *node);
+
+    // An expression of a FlatAst being checked by CheckExpr().
+    struct FlatExprFrame {
+        uint32_t expr;
+        uint32_t next_child;        // Number of steps done.
+        uint32_t first_arg;         // The arguments of a call, in arg_stack_.
+    };
+
+    void CheckDecl(FlatStmt &decl, SymbolKind kind, uint32_t slot);
+    void CheckStmt(uint32_t stmt, FlatFunc &func);
+    void CheckExpr(uint32_t root);
+    uint32_t CheckStep(FlatExprFrame &frame);
+
     void CreateAllBuiltinFunctions();
-    void CreateBuiltinFunction(std::string func_name, VarType return_type, std::vector<VarType> params);
+    void CreateBuiltinFunction(std::string_view func_name, VarType return_type, std::vector<VarType> params);
+
+    template <typename T>
+    T *LookUp(Symbol name, SymbolKind *kind = nullptr) const;
 
-    SymbolTable &SymTab() { return symbol_tables_.back(); }
+    // The checks of a tree and of a FlatAst, each reporting its error. The
+    // lookups return what LookUp<T>() does, but never nullptr.
+    void Declare(Symbol name, SymbolKind kind, void *target, Position pos);
     template <typename T>
-    T *LookUp(const std::string &name) const;
+    T *LookUpVariable(Symbol name, Position pos, SymbolKind *kind = nullptr);
+    template <typename T>
+    T *LookUpAssigned(Symbol name, Position pos);
+    template <typename T>
+    T *LookUpFunction(Symbol name, Position pos);
+    void CheckInitializer(Symbol name, VarType type, VarType init_type, Position init_pos);
+    void CheckReturn(Symbol func_name, VarType return_type, bool has_value, VarType type, Position pos);
+    void CheckAssign(Symbol name, VarType type, VarType rhs_type, Position rhs_pos);
+    VarType CheckNegate(VarType operand_type, Position pos);
+    VarType CheckOperator(TokenType op, VarType left_type, VarType right_type, Position pos);
+    void CheckNumArgs(Symbol func_name, size_t num_params, size_t num_args, Position pos);
+    void CheckArg(Symbol func_name, VarType param_type, VarType arg_type, Position arg_pos);
+
     void Error(Position error_pos);
     void EnterScope();
     void LeaveScope();
 
 private:
     std::string filename_;
+    std::shared_ptr<SourceBuffer> source_;
     std::ostringstream error_;
-    std::vector<SymbolTable> symbol_tables_;
-    std::vector<Ptr<FuncDefNode>> builtin_funcs_;
+    SymbolTable symbols_;
+    Arena builtin_arena_;                   // Nodes of the builtin functions.
+    std::vector<FuncDefNode *> builtin_funcs_;
+    Parser *parser_ = nullptr;
+    std::vector<ExprFrame> expr_stack_;
+    FuncDefNode *func_ = nullptr;           // Being checked, for the slots of its locals.
+    uint32_t num_globals_ = 0;
+
+    unsigned num_threads_ = 1;
+    const SymbolTable *global_scope_ = nullptr;     // Of the parent of a worker.
+    bool exit_on_error_ = true;                     // Or keep the error and throw.
+    Position error_pos_;
+    std::string error_message_;
+
+    FlatAst *flat_ = nullptr;
+    std::vector<FlatFunc> flat_builtins_;   // The builtin functions, for a FlatAst.
+    std::vector<FlatExprFrame> flat_expr_stack_;
+    std::vector<uint32_t> arg_stack_;       // Arguments of the calls being checked.
 };
 
+// T is FuncDefNode or DeclStmtNode, or FlatFunc or FlatStmt while checking a
+// FlatAst. Names bound to the other kind are skipped.
 template <typename T>
-T *TypeChecker::LookUp(const std::string &name) const {
-    for (int i = symbol_tables_.size() - 1; i >= 0; --i) {
-        T *p = dynamic_cast<T*>(symbol_tables_[i].LookUp(name));
-        if (p != nullptr)
-            return p;
-    }
-
-    return nullptr;
+T *TypeChecker::LookUp(Symbol name, SymbolKind *kind) const {
+    constexpr bool is_func = std::is_same_v<T, FuncDefNode> || std::is_same_v<T, FlatFunc>;
+    void *target = symbols_.LookUp(name, is_func, kind);
+    if (target == nullptr && global_scope_)
+        target = global_scope_->LookUp(name, is_func, kind);
+    return static_cast<T *>(target);
 }
 
 #endif // ANALYZER_H
@@ -0,0 +1,42 @@
+#include "arena.h"
+
+#include <algorithm>
+
+static constexpr size_t kMinBlockSize = 16 * 1024;
+static constexpr size_t kMaxBlockSize = 4 * 1024 * 1024;
+
+// Blocks double in size so that small programs stay small, up to a limit
+// that bounds the waste at the end of the last block.
+void Arena::NewBlock(size_t min_size) {
+    size_t size = std::max(next_block_size_, kMinBlockSize);
+    next_block_size_ = std::min(size * 2, kMaxBlockSize);
+    size = std::max(size, min_size);
+
+    blocks_.emplace_back(new char[size]);
+    cur_ = blocks_.back().get();
+    end_ = cur_ + size;
+    capacity_ += size;
+}
+
+void Arena::Adopt(Arena &other) {
+    for (auto &block : other.blocks_)
+        blocks_.push_back(std::move(block));
+    capacity_ += other.capacity_;
+
+    other.blocks_.clear();
+    other.cur_ = nullptr;
+    other.end_ = nullptr;
+    other.next_block_size_ = 0;
+    other.capacity_ = 0;
+}
+
+void Arena::Reset() {
+    if (blocks_.empty())
+        return;
+
+    std::unique_ptr<char[]> last = std::move(blocks_.back());
+    blocks_.clear();
+    capacity_ = end_ - last.get();
+    cur_ = last.get();
+    blocks_.push_back(std::move(last));
+}
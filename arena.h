@@ -0,0 +1,88 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A fixed-size array that lives in an arena.
+template <typename T>
+class Span {
+public:
+    Span() = default;
+    Span(T *data, size_t size) : data_(data), size_(size) {}
+
+    T *begin() const { return data_; }
+    T *end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T &operator[](size_t i) const { return data_[i]; }
+
+private:
+    T *data_ = nullptr;
+    uint32_t size_ = 0;
+};
+
+// Bump allocator for objects that die together. Nothing is freed before the
+// arena goes away, and destructors never run, so only trivially destructible
+// types can be put in it.
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *Allocate(size_t size, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+        if (p + size > reinterpret_cast<uintptr_t>(end_)) {
+            NewBlock(size + align);
+            p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+        }
+        cur_ = reinterpret_cast<char *>(p + size);
+        return reinterpret_cast<void *>(p);
+    }
+
+    template <typename T, typename... Args>
+    T *New(Args &&...args) {
+        static_assert(std::is_trivially_destructible_v<T>,
+                      "Arena objects are never destroyed");
+        return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // An array of n value-initialized elements.
+    template <typename T>
+    Span<T> NewArray(size_t n) {
+        static_assert(std::is_trivially_destructible_v<T>,
+                      "Arena objects are never destroyed");
+        T *data = static_cast<T *>(Allocate(n * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < n; ++i)
+            new (data + i) T();
+        return {data, n};
+    }
+
+    // Total size of the blocks allocated so far.
+    size_t Capacity() const { return capacity_; }
+
+    // Take over the blocks of `other`, so that its objects live as long as
+    // this arena. `other` is left empty.
+    void Adopt(Arena &other);
+
+    // Drop all objects, keeping the last block for the next ones.
+    void Reset();
+
+private:
+    void NewBlock(size_t min_size);
+
+private:
+    char *cur_ = nullptr;
+    char *end_ = nullptr;
+    size_t next_block_size_ = 0;
+    size_t capacity_ = 0;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+};
+
+#endif // ARENA_H_
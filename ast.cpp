@@ -1,16 +1,18 @@
 #include "ast.h"
 
-#include <map>
-
-static const std::map<VarType, std::string> TYPE_NAMES {
-    {kInt, "int"},
-    {kDouble, "double"},
-    {kBool, "bool"},
-    {kVoid, "void"},
+// Indexed by VarType.
+static constexpr const char *TYPE_NAMES[] {
+    "int",
+    "double",
+    "bool",
+    "void",
 };
 
-const std::string &TypeToString(VarType type) {
-    return TYPE_NAMES.at(type);
+static_assert(sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]) == kVoid + 1,
+              "TYPE_NAMES must have an entry for every VarType");
+
+const char *TypeToString(VarType type) {
+    return TYPE_NAMES[type];
 }
 
 static void PrintSpaces(std::ostream &os, int n) {
@@ -67,7 +69,7 @@ void BlockStmtNode::Print(std::ostream &out, int depth) const {
 
 void FuncDefNode::Print(std::ostream &out, int depth) const {
     PrintSpaces(out, depth);
-    out << "Function: " << name
+    out << "Function: " << SymbolName(name)
         << "(";
 
     for (int i = 0; i < params.size(); ++i) {
@@ -78,7 +80,7 @@ void FuncDefNode::Print(std::ostream &out, int depth) const {
 
         if (param->is_const)
             out << "const ";
-        out << param->name
+        out << SymbolName(param->name)
             << ": " << VarTypeToString(param->type);
     }
 
@@ -94,7 +96,7 @@ void DeclStmtNode::Print(std::ostream &out, int depth) const {
     if (is_const)
         out << "const ";
 
-    out << name << ": " << VarTypeToString(type) << "\n";
+    out << SymbolName(name) << ": " << VarTypeToString(type) << "\n";
 
     if (initializer) {
         PrintSpaces(out, depth + 1);
@@ -162,13 +164,13 @@ void ExprStmtNode::Print(std::ostream &out, int depth) const {
 
 void IdentExprNode::Print(std::ostream &out, int depth) const {
     PrintSpaces(out, depth);
-    out << "ID: " << var_name << '\n';
+    out << "ID: " << SymbolName(var_name) << '\n';
 }
 
 void AssignExprNode::Print(std::ostream &out, int depth) const {
     PrintSpaces(out, depth);
 
-    out << "Assignment: " << lhs << " = :\n";
+    out << "Assignment: " << SymbolName(lhs) << " = :\n";
     rhs->Print(out, depth + 1);
 }
 
@@ -196,7 +198,7 @@ void NegateExpr::Print(std::ostream &out, int depth) const {
 void CallExprNode::Print(std::ostream &out, int depth) const {
     PrintSpaces(out, depth);
 
-    out << "Call function: " << func_name << ", ";
+    out << "Call function: " << SymbolName(func_name) << ", ";
     if (args.empty()) {
         out << "without arguments.\n";
     } else {
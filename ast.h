@@ -4,7 +4,10 @@
 #include <memory>
 #include <vector>
 #include <ostream>
+#include <string_view>
+#include "arena.h"
 #include "scanner.h"
+#include "interner.h"
 
 enum VarType {
     kInt,
@@ -13,11 +16,24 @@ enum VarType {
     kVoid,
 };
 
-const std::string &TypeToString(VarType type);
+const char *TypeToString(VarType type);
 
 struct ExprType {
     VarType type = kVoid;
-    bool is_const = false;
+    bool is_const = false;      // The value is known at compile time.
+
+    // The value of a constant. A bool is what the VM leaves on the stack
+    // for the comparison, see ConstFolder.
+    union {
+        int64_t int_value = 0;
+        double double_value;
+    };
+};
+
+enum VarScope {
+    kLocal,
+    kGlobal,
+    kParam,
 };
 
 struct ProgramNode;
@@ -38,6 +54,24 @@ struct IdentExprNode;
 
 struct FuncDefNode;
 
+// The concrete type of a node, see AstWalker.
+enum NodeKind : uint8_t {
+    kProgramNode,
+    kExprStmtNode,
+    kDeclStmtNode,
+    kIfStmtNode,
+    kWhileStmtNode,
+    kReturnStmtNode,
+    kBlockStmtNode,
+    kOperatorExprNode,
+    kNegateExpr,
+    kAssignExprNode,
+    kCallExprNode,
+    kLiteralExprNode,
+    kIdentExprNode,
+    kFuncDefNode,
+};
+
 class AstVisitor {
 public:
     virtual void Visit(ProgramNode *node) = 0;
@@ -65,137 +99,201 @@ const auto MakePtr = std::make_unique<T>;
 template <typename T>
 using PtrVec = std::vector<std::unique_ptr<T>>;
 
+// Nodes other than ProgramNode live in the arena of their program and are
+// never destroyed one by one, see ProgramNode::arena.
 struct Node {
+    explicit Node(NodeKind kind) : kind(kind) {}
+
     Position pos;
+    const NodeKind kind;
 
-    virtual ~Node() {};
     virtual void Print(std::ostream &out, int depth=0) const = 0;
     virtual void Accept(AstVisitor &visitor) = 0;
 };
 
 struct ExprNode : public Node {
+    using Node::Node;
+
     ExprType type = {kVoid, false};
 };
 
-struct StmtNode : public Node {};
+struct StmtNode : public Node {
+    using Node::Node;
+};
 
-struct ProgramNode : public Node {
+struct ProgramNode final : public Node {
+    ProgramNode() : Node(kProgramNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    PtrVec<DeclStmtNode> global_vars;
-    PtrVec<FuncDefNode> functions;
+    Span<DeclStmtNode *> global_vars;
+    Span<FuncDefNode *> functions;
+
+    // The text that the names in the tree point into.
+    std::shared_ptr<SourceBuffer> source;
+
+    // Owns every other node of the tree and their child arrays.
+    Arena arena;
 };
 
 struct BlockStmtNode : public StmtNode {
+    BlockStmtNode() : StmtNode(kBlockStmtNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    PtrVec<StmtNode> statements;
+    Span<StmtNode *> statements;
     bool is_func_body = false;
 };
 
 struct FuncDefNode : public Node {
+    FuncDefNode() : Node(kFuncDefNode) {}
     void Print(std::ostream &out, int depth=0) const override;    
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    std::string name;
-    PtrVec<DeclStmtNode> params;
-    Ptr<BlockStmtNode> body;
+    Symbol name = kNoSymbol;
+    Span<DeclStmtNode *> params;
+    BlockStmtNode *body = nullptr;
     VarType return_type = kVoid;
+    uint32_t num_locals = 0;        // Set by the TypeChecker.
 };
 
 struct DeclStmtNode : public StmtNode {
+    DeclStmtNode() : StmtNode(kDeclStmtNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    std::string name;
+    Symbol name = kNoSymbol;
     VarType type = kVoid;
     bool is_const = false;
-    Ptr<ExprNode> initializer;
+    ExprNode *initializer = nullptr;
+
+    // Where the variable lives, set by the TypeChecker: its index among the
+    // globals, the parameters, or all locals of its function.
+    VarScope scope = kLocal;
+    uint32_t slot = 0;
 };
 
 struct CondBody {
-    Ptr<ExprNode> condition;
-    Ptr<BlockStmtNode> body;
+    ExprNode *condition = nullptr;
+    BlockStmtNode *body = nullptr;
 };
 
 struct IfStmtNode : public StmtNode {
+    IfStmtNode() : StmtNode(kIfStmtNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
     CondBody if_part;
-    std::vector<CondBody> elif_part;
-    Ptr<BlockStmtNode> else_part;
+    Span<CondBody> elif_part;
+    BlockStmtNode *else_part = nullptr;
 };
 
 struct WhileStmtNode : public StmtNode {
+    WhileStmtNode() : StmtNode(kWhileStmtNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    Ptr<ExprNode> condition;
-    Ptr<BlockStmtNode> body;
+    ExprNode *condition = nullptr;
+    BlockStmtNode *body = nullptr;
 };
 
 struct ReturnStmtNode : public StmtNode {
+    ReturnStmtNode() : StmtNode(kReturnStmtNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    FuncDefNode *func;
-    Ptr<ExprNode> expr;
+    FuncDefNode *func = nullptr;
+    ExprNode *expr = nullptr;
 };
 
 struct ExprStmtNode : public StmtNode {
+    ExprStmtNode() : StmtNode(kExprStmtNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    Ptr<ExprNode> expr;
+    ExprNode *expr = nullptr;
 };
 
 struct IdentExprNode : public ExprNode {
+    IdentExprNode() : ExprNode(kIdentExprNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    std::string var_name;
+    Symbol var_name = kNoSymbol;
+    DeclStmtNode *decl = nullptr;   // Set by the TypeChecker.
 };
 
 struct AssignExprNode : public ExprNode {
+    AssignExprNode() : ExprNode(kAssignExprNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    std::string lhs;
-    Ptr<ExprNode> rhs;
+    Symbol lhs = kNoSymbol;
+    DeclStmtNode *decl = nullptr;   // Set by the TypeChecker.
+    ExprNode *rhs = nullptr;
 };
 
 struct LiteralExprNode : public ExprNode {
+    LiteralExprNode() : ExprNode(kLiteralExprNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    std::string lexeme;
+    std::string_view lexeme;    // Only kept for printing, the value is in `type`.
 };
 
 struct OperatorExprNode : public ExprNode {
+    OperatorExprNode() : ExprNode(kOperatorExprNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
     TokenType op;
-    Ptr<ExprNode> left;
-    Ptr<ExprNode> right;
+    ExprNode *left = nullptr;
+    ExprNode *right = nullptr;
 };
 
 struct NegateExpr : public ExprNode {
+    NegateExpr() : ExprNode(kNegateExpr) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    Ptr<ExprNode> operand;
+    ExprNode *operand = nullptr;
 };
 
 struct CallExprNode : public ExprNode {
+    CallExprNode() : ExprNode(kCallExprNode) {}
     void Print(std::ostream &out, int depth=0) const override;
     void Accept(AstVisitor &v) override { v.Visit(this); }
 
-    std::string func_name;
-    PtrVec<ExprNode> args;
+    Symbol func_name = kNoSymbol;
+    Span<ExprNode *> args;
+    FuncDefNode *func = nullptr;    // Set by the TypeChecker.
+};
+
+// Static counterpart of AstVisitor for the passes of the compiler. Walk()
+// switches on the kind of the node and calls Derived::Visit() directly, so
+// walking a tree makes no virtual calls and small Visit()s can be inlined.
+template <typename Derived>
+class AstWalker {
+public:
+    void Walk(Node *node) {
+        Derived &self = static_cast<Derived &>(*this);
+        switch (node->kind) {
+        case kProgramNode: self.Visit(static_cast<ProgramNode *>(node)); break;
+        case kExprStmtNode: self.Visit(static_cast<ExprStmtNode *>(node)); break;
+        case kDeclStmtNode: self.Visit(static_cast<DeclStmtNode *>(node)); break;
+        case kIfStmtNode: self.Visit(static_cast<IfStmtNode *>(node)); break;
+        case kWhileStmtNode: self.Visit(static_cast<WhileStmtNode *>(node)); break;
+        case kReturnStmtNode: self.Visit(static_cast<ReturnStmtNode *>(node)); break;
+        case kBlockStmtNode: self.Visit(static_cast<BlockStmtNode *>(node)); break;
+        case kOperatorExprNode: self.Visit(static_cast<OperatorExprNode *>(node)); break;
+        case kNegateExpr: self.Visit(static_cast<NegateExpr *>(node)); break;
+        case kAssignExprNode: self.Visit(static_cast<AssignExprNode *>(node)); break;
+        case kCallExprNode: self.Visit(static_cast<CallExprNode *>(node)); break;
+        case kLiteralExprNode: self.Visit(static_cast<LiteralExprNode *>(node)); break;
+        case kIdentExprNode: self.Visit(static_cast<IdentExprNode *>(node)); break;
+        case kFuncDefNode: self.Visit(static_cast<FuncDefNode *>(node)); break;
+        }
+    }
 };
 
 #endif // AST_H_
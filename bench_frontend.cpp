@@ -0,0 +1,564 @@
+#include "analyzer.h"
+#include "compiler.h"
+#include "const_folder.h"
+#include "corpus_gen.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+
+using namespace std;
+
+// Every allocation of the process goes through these, so that the phases
+// can report how many they make.
+static atomic<uint64_t> g_allocations{0};
+static atomic<uint64_t> g_allocated_bytes{0};
+
+void *operator new(size_t size) {
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    g_allocated_bytes.fetch_add(size, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+
+// Start a new peak RSS measurement. Needs Linux 4.0 or later, older kernels
+// keep reporting the peak of the whole process.
+static void ResetPeakRss() {
+    ofstream("/proc/self/clear_refs") << "5";
+}
+
+static uint64_t PeakRssKb() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return strtoull(line.c_str() + 6, nullptr, 10);
+    }
+    return 0;
+}
+
+class NodeCounter : public AstVisitor {
+public:
+    size_t Count() const { return count_; }
+
+    void Visit(ProgramNode *node) override {
+        ++count_;
+        for (const auto &var : node->global_vars)
+            var->Accept(*this);
+        for (const auto &func : node->functions)
+            func->Accept(*this);
+    }
+
+    void Visit(FuncDefNode *node) override {
+        ++count_;
+        for (const auto &param : node->params)
+            param->Accept(*this);
+        node->body->Accept(*this);
+    }
+
+    void Visit(BlockStmtNode *node) override {
+        ++count_;
+        for (const auto &stmt : node->statements)
+            stmt->Accept(*this);
+    }
+
+    void Visit(DeclStmtNode *node) override {
+        ++count_;
+        if (node->initializer)
+            node->initializer->Accept(*this);
+    }
+
+    void Visit(IfStmtNode *node) override {
+        ++count_;
+        node->if_part.condition->Accept(*this);
+        node->if_part.body->Accept(*this);
+        for (const auto &cond_body : node->elif_part) {
+            cond_body.condition->Accept(*this);
+            cond_body.body->Accept(*this);
+        }
+        if (node->else_part)
+            node->else_part->Accept(*this);
+    }
+
+    void Visit(WhileStmtNode *node) override {
+        ++count_;
+        node->condition->Accept(*this);
+        node->body->Accept(*this);
+    }
+
+    void Visit(ReturnStmtNode *node) override {
+        ++count_;
+        if (node->expr)
+            node->expr->Accept(*this);
+    }
+
+    void Visit(ExprStmtNode *node) override {
+        ++count_;
+        node->expr->Accept(*this);
+    }
+
+    void Visit(OperatorExprNode *node) override {
+        ++count_;
+        node->left->Accept(*this);
+        node->right->Accept(*this);
+    }
+
+    void Visit(NegateExpr *node) override {
+        ++count_;
+        node->operand->Accept(*this);
+    }
+
+    void Visit(AssignExprNode *node) override {
+        ++count_;
+        node->rhs->Accept(*this);
+    }
+
+    void Visit(CallExprNode *node) override {
+        ++count_;
+        for (const auto &arg : node->args)
+            arg->Accept(*this);
+    }
+
+    void Visit(LiteralExprNode *) override { ++count_; }
+    void Visit(IdentExprNode *) override { ++count_; }
+
+private:
+    size_t count_ = 0;
+};
+
+struct PhaseResult {
+    double seconds = 0;             // Best of all iterations.
+    uint64_t tokens = 0;
+    uint64_t ast_nodes = 0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    uint64_t peak_rss_kb = 0;
+};
+
+struct BenchOptions {
+    ScanMode scan_mode = kScanStreaming;
+    unsigned num_threads = DefaultThreadCount();
+    int iterations = 3;
+    bool codegen = false;
+    bool latency = false;
+    bool fold = false;
+};
+
+struct CodegenResult {
+    unsigned threads = 0;
+    PhaseResult phase;
+};
+
+struct FoldResult {
+    PhaseResult phase;              // Of the folding alone.
+    size_t instructions = 0;        // Without folding.
+    size_t folded_instructions = 0;
+};
+
+struct LatencyResult {
+    PhaseResult staged;
+    PhaseResult pipelined;
+};
+
+// Run `body` the given number of times and keep the fastest run. Allocation
+// counts are deterministic, so the ones of the last run are reported.
+// `setup` runs untimed before each run.
+template <typename Setup, typename Body>
+static PhaseResult Measure(int iterations, Setup setup, Body body) {
+    PhaseResult result;
+    for (int i = 0; i < iterations; ++i) {
+        setup();
+        ResetPeakRss();
+        const uint64_t allocations = g_allocations.load();
+        const uint64_t allocated_bytes = g_allocated_bytes.load();
+
+        PhaseResult run;
+        auto start = chrono::steady_clock::now();
+        body(run);
+        auto end = chrono::steady_clock::now();
+
+        run.seconds = chrono::duration<double>(end - start).count();
+        run.allocations = g_allocations.load() - allocations;
+        run.allocated_bytes = g_allocated_bytes.load() - allocated_bytes;
+        run.peak_rss_kb = max(result.peak_rss_kb, PeakRssKb());
+        if (i > 0)
+            run.seconds = min(run.seconds, result.seconds);
+        result = run;
+    }
+    return result;
+}
+
+static PhaseResult BenchScan(const string &filename, const BenchOptions &options) {
+    return Measure(options.iterations, [] {}, [&](PhaseResult &run) {
+        Scanner scanner(options.scan_mode);
+        scanner.SetThreads(options.num_threads);
+        scanner.ScanFile(filename);
+        while (scanner.GetToken().type != kEof)
+            ++run.tokens;
+    });
+}
+
+static PhaseResult BenchParse(const string &filename, const BenchOptions &options) {
+    Ptr<ProgramNode> program;
+    PhaseResult result = Measure(options.iterations, [&] { program.reset(); }, [&](PhaseResult &) {
+        Parser parser(options.scan_mode);
+        parser.SetScanThreads(options.num_threads);
+        program = parser.ParseFile(filename);
+    });
+
+    NodeCounter counter;
+    program->Accept(counter);
+    result.ast_nodes = counter.Count();
+    return result;
+}
+
+// Compile the program with 1, 2, 4, ... threads up to num_threads, to see
+// how code generation scales. The program is parsed and checked once,
+// outside of the measurements, and the output goes nowhere.
+static vector<CodegenResult> BenchCodegen(const string &filename, const BenchOptions &options,
+                                          size_t &num_functions) {
+    Parser parser(options.scan_mode);
+    parser.SetScanThreads(options.num_threads);
+    Ptr<ProgramNode> program = parser.ParseFile(filename);
+    TypeChecker checker(filename);
+    program->Accept(checker);
+    num_functions = program->functions.size();
+
+    vector<CodegenResult> results;
+    for (unsigned threads = 1; ; threads = min(threads * 2, options.num_threads)) {
+        CodegenResult result;
+        result.threads = threads;
+        result.phase = Measure(options.iterations, [] {}, [&](PhaseResult &) {
+            ostream out(nullptr);
+            Compiler compiler(out);
+            compiler.SetThreads(threads);
+            compiler.Compile(program.get());
+        });
+        results.push_back(result);
+
+        if (threads == options.num_threads)
+            break;
+    }
+    return results;
+}
+
+// Count the instructions generated with and without the ConstFolder, and
+// time the folding alone. Each run folds a freshly parsed and checked tree.
+static FoldResult BenchFold(const string &filename, const BenchOptions &options) {
+    Ptr<ProgramNode> program;
+    auto parse_and_check = [&] {
+        Parser parser(options.scan_mode);
+        parser.SetScanThreads(options.num_threads);
+        program = parser.ParseFile(filename);
+        TypeChecker checker(filename);
+        program->Accept(checker);
+    };
+    auto count_instructions = [&] {
+        ostream out(nullptr);
+        Compiler compiler(out);
+        compiler.Compile(program.get());
+        return compiler.NumInstructions();
+    };
+
+    FoldResult result;
+    parse_and_check();
+    result.instructions = count_instructions();
+    result.phase = Measure(options.iterations, parse_and_check, [&](PhaseResult &) {
+        ConstFolder folder;
+        folder.Fold(program.get());
+    });
+    result.folded_instructions = count_instructions();
+    return result;
+}
+
+// Wall-clock time from the start to the written output file, with the
+// passes one after the other and with the Pipeline, which needs an eager
+// scan mode.
+static LatencyResult BenchLatency(const string &filename, const string &output,
+                                  const BenchOptions &options) {
+    LatencyResult result;
+    result.staged = Measure(options.iterations, [] {}, [&](PhaseResult &) {
+        Parser parser(options.scan_mode);
+        parser.SetScanThreads(options.num_threads);
+        Ptr<ProgramNode> program = parser.ParseFile(filename);
+        TypeChecker checker(filename);
+        program->Accept(checker);
+        ofstream out(output, ios::binary);
+        Compiler compiler(out);
+        compiler.Compile(program.get());
+    });
+
+    const ScanMode scan_mode = options.scan_mode == kScanStreaming ? kScanEager : options.scan_mode;
+    result.pipelined = Measure(options.iterations, [] {}, [&](PhaseResult &) {
+        Parser parser(scan_mode);
+        parser.SetScanThreads(options.num_threads);
+        TypeChecker checker(filename);
+        ofstream out(output, ios::binary);
+        Compiler compiler(out);
+        Pipeline pipeline(checker, compiler, options.num_threads);
+        Ptr<ProgramNode> program = pipeline.Run(parser, filename);
+        pipeline.Assemble(program.get());
+    });
+    return result;
+}
+
+static void PrintLatency(ostream &out, const LatencyResult &result) {
+    out << "  \"latency\": {\n"
+        << "    \"staged_seconds\": " << result.staged.seconds << ",\n"
+        << "    \"pipelined_seconds\": " << result.pipelined.seconds << ",\n"
+        << "    \"speedup\": " << result.staged.seconds / max(result.pipelined.seconds, 1e-9) << ",\n"
+        << "    \"staged_peak_rss_kb\": " << result.staged.peak_rss_kb << ",\n"
+        << "    \"pipelined_peak_rss_kb\": " << result.pipelined.peak_rss_kb << "\n"
+        << "  }";
+}
+
+static void PrintFold(ostream &out, const FoldResult &result) {
+    const size_t removed = result.instructions - result.folded_instructions;
+    out << "  \"fold\": {\n"
+        << "    \"seconds\": " << result.phase.seconds << ",\n"
+        << "    \"instructions\": " << result.instructions << ",\n"
+        << "    \"folded_instructions\": " << result.folded_instructions << ",\n"
+        << "    \"removed\": " << removed << ",\n"
+        << "    \"removed_share\": " << double(removed) / max<size_t>(result.instructions, 1) << "\n"
+        << "  }";
+}
+
+static void PrintCodegen(ostream &out, const vector<CodegenResult> &results, size_t num_functions) {
+    out << "  \"codegen\": {\n"
+        << "    \"functions\": " << num_functions << ",\n"
+        << "    \"runs\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const PhaseResult &result = results[i].phase;
+        const double seconds = max(result.seconds, 1e-9);
+        out << "      {\"threads\": " << results[i].threads
+            << ", \"seconds\": " << result.seconds
+            << ", \"functions_per_sec\": " << num_functions / seconds
+            << ", \"speedup\": " << results[0].phase.seconds / seconds
+            << ", \"peak_rss_kb\": " << result.peak_rss_kb << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "    ]\n"
+        << "  }";
+}
+
+static void PrintPhase(ostream &out, const char *name, const PhaseResult &result,
+                       uint64_t bytes, uint64_t tokens) {
+    const double seconds = max(result.seconds, 1e-9);
+    out << "  \"" << name << "\": {\n"
+        << "    \"seconds\": " << result.seconds << ",\n"
+        << "    \"tokens\": " << tokens << ",\n"
+        << "    \"tokens_per_sec\": " << tokens / seconds << ",\n"
+        << "    \"mb_per_sec\": " << bytes / seconds / 1e6 << ",\n";
+    if (result.ast_nodes > 0) {
+        out << "    \"ast_nodes\": " << result.ast_nodes << ",\n"
+            << "    \"ast_nodes_per_sec\": " << result.ast_nodes / seconds << ",\n";
+    }
+    out << "    \"allocations\": " << result.allocations << ",\n"
+        << "    \"allocated_bytes\": " << result.allocated_bytes << ",\n"
+        << "    \"peak_rss_kb\": " << result.peak_rss_kb << "\n"
+        << "  }";
+}
+
+// Accepts a K, M or G suffix.
+static uint64_t ParseSize(const string &s) {
+    char *end;
+    uint64_t size = strtoull(s.c_str(), &end, 10);
+    switch (*end) {
+    case 'G': case 'g': size <<= 10; [[fallthrough]];
+    case 'M': case 'm': size <<= 10; [[fallthrough]];
+    case 'K': case 'k': size <<= 10; break;
+    }
+    return size;
+}
+
+static const char *ScanModeName(ScanMode mode) {
+    switch (mode) {
+    case kScanEager: return "eager";
+    case kScanParallel: return "parallel";
+    default: return "streaming";
+    }
+}
+
+static void Usage(const char *argv0) {
+    cout << "Usage: " << argv0 << " [options] [<input>]\n"
+         << "Without an input, a program is generated from these options:\n"
+         << "  --size=N[K|M|G]        approximate size, default 1M\n"
+         << "  --ident-density=F      share of expression leaves that are variables\n"
+         << "  --literal-density=F    share of expression leaves that are literals\n"
+         << "  --expr-depth=N         maximum expression depth\n"
+         << "  --functions=N          number of functions, 0 for one per 2 KB\n"
+         << "  --seed=N\n"
+         << "  --corpus=FILE          where to write it, default bench_corpus.c0\n"
+         << "Other options:\n"
+         << "  --eager-scan | --parallel-scan\n"
+         << "  --threads=N\n"
+         << "  --iterations=N         runs per phase, the fastest is reported\n"
+         << "  --codegen              also compile with 1, 2, 4, ... threads up to N\n"
+         << "  --latency              also time whole compiles, staged and pipelined\n"
+         << "  --fold                 also count the instructions that folding saves\n"
+         << "  --output=FILE          where they write, default bench_output.bin\n"
+         << "  --json=FILE            write the results to FILE instead of stdout" << endl;
+}
+
+int main(int argc, char const *argv[]) {
+    CorpusOptions corpus;
+    BenchOptions options;
+    string input;
+    string corpus_file = "bench_corpus.c0";
+    string json_file;
+    string output_file = "bench_output.bin";
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        auto value = [&](const char *prefix) {
+            return arg.compare(0, strlen(prefix), prefix) == 0 ? arg.c_str() + strlen(prefix) : nullptr;
+        };
+
+        if (const char *v = value("--size=")) {
+            corpus.size = ParseSize(v);
+        } else if (const char *v = value("--ident-density=")) {
+            corpus.ident_density = atof(v);
+        } else if (const char *v = value("--literal-density=")) {
+            corpus.literal_density = atof(v);
+        } else if (const char *v = value("--expr-depth=")) {
+            corpus.expr_depth = max(0, atoi(v));
+        } else if (const char *v = value("--functions=")) {
+            corpus.num_functions = strtoul(v, nullptr, 10);
+        } else if (const char *v = value("--seed=")) {
+            corpus.seed = strtoul(v, nullptr, 10);
+        } else if (const char *v = value("--corpus=")) {
+            corpus_file = v;
+        } else if (const char *v = value("--threads=")) {
+            options.num_threads = max(1, atoi(v));
+        } else if (const char *v = value("--iterations=")) {
+            options.iterations = max(1, atoi(v));
+        } else if (const char *v = value("--json=")) {
+            json_file = v;
+        } else if (const char *v = value("--output=")) {
+            output_file = v;
+        } else if (arg == "--eager-scan") {
+            options.scan_mode = kScanEager;
+        } else if (arg == "--parallel-scan") {
+            options.scan_mode = kScanParallel;
+        } else if (arg == "--codegen") {
+            options.codegen = true;
+        } else if (arg == "--latency") {
+            options.latency = true;
+        } else if (arg == "--fold") {
+            options.fold = true;
+        } else if (arg[0] != '-' && input.empty()) {
+            input = arg;
+        } else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    CorpusStats stats;
+    const bool generated = input.empty();
+    if (generated) {
+        ofstream out(corpus_file, ios::binary);
+        if (!out.is_open()) {
+            cout << "Cannot open the file " << corpus_file << endl;
+            return 1;
+        }
+        stats = GenerateCorpus(corpus, out);
+        input = corpus_file;
+    } else {
+        ifstream in(input, ios::binary | ios::ate);
+        if (!in.is_open()) {
+            cout << "Cannot open the file " << input << endl;
+            return 1;
+        }
+        stats.bytes = in.tellg();
+    }
+
+    PhaseResult scan = BenchScan(input, options);
+    PhaseResult parse = BenchParse(input, options);
+    vector<CodegenResult> codegen;
+    size_t num_functions = 0;
+    if (options.codegen)
+        codegen = BenchCodegen(input, options, num_functions);
+    LatencyResult latency;
+    if (options.latency)
+        latency = BenchLatency(input, output_file, options);
+    FoldResult fold;
+    if (options.fold)
+        fold = BenchFold(input, options);
+
+    ofstream json_out;
+    if (!json_file.empty()) {
+        json_out.open(json_file);
+        if (!json_out.is_open()) {
+            cout << "Cannot open the file " << json_file << endl;
+            return 1;
+        }
+    }
+    ostream &out = json_file.empty() ? cout : json_out;
+
+    out << "{\n"
+        << "  \"input\": \"" << input << "\",\n"
+        << "  \"bytes\": " << stats.bytes << ",\n";
+    if (generated) {
+        out << "  \"corpus\": {\n"
+            << "    \"size\": " << corpus.size << ",\n"
+            << "    \"ident_density\": " << corpus.ident_density << ",\n"
+            << "    \"literal_density\": " << corpus.literal_density << ",\n"
+            << "    \"expr_depth\": " << corpus.expr_depth << ",\n"
+            << "    \"functions\": " << stats.num_functions << ",\n"
+            << "    \"lines\": " << stats.lines << ",\n"
+            << "    \"seed\": " << corpus.seed << "\n"
+            << "  },\n";
+    }
+    out << "  \"scan_mode\": \"" << ScanModeName(options.scan_mode) << "\",\n"
+        << "  \"threads\": " << options.num_threads << ",\n"
+        << "  \"iterations\": " << options.iterations << ",\n";
+    PrintPhase(out, "scan", scan, stats.bytes, scan.tokens);
+    out << ",\n";
+    PrintPhase(out, "parse", parse, stats.bytes, scan.tokens);
+    if (options.codegen) {
+        out << ",\n";
+        PrintCodegen(out, codegen, num_functions);
+    }
+    if (options.latency) {
+        out << ",\n";
+        PrintLatency(out, latency);
+    }
+    if (options.fold) {
+        out << ",\n";
+        PrintFold(out, fold);
+    }
+    out << "\n}" << endl;
+
+    return 0;
+}
@@ -1,8 +1,12 @@
 
 #include "compiler.h"
 
+#include <algorithm>
 #include <set>
 #include <cstdlib>
+#include <cstring>
+
+#include "thread_pool.h"
 
 // static const std::set<std::string> BUILTIN_FUNCS {
 //     "getint",
@@ -45,21 +49,23 @@ void Instruction::PackUint64Param(int64_t x) {
     param = x;
 }
 
-void ProgramBinary::AddGlobalVar(const std::string &name, VarType type) {
+void ProgramBinary::AddGlobalVar() {
     GlobalDef def;
-    def.value.resize(4);
-
-    Variable var;
-    var.offset = globals.size();
-    var.scope = kGlobal;
-    var.type = type;
-
-    global_vars.emplace(name, var);
-
+    def.value.resize(8);
     globals.push_back(std::move(def));
 }
 
-void ProgramBinary::AddGlobalFuncName(const std::string &func_name) {
+// The VM loads the value as it is into memory, where its Load64 reads it
+// little-endian.
+void ProgramBinary::SetGlobalValue(uint32_t offset, uint64_t value, bool is_const) {
+    GlobalDef &def = globals[offset];
+    def.is_const = is_const;
+    for (size_t i = 0; i < def.value.size(); ++i) {
+        def.value[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+void ProgramBinary::AddGlobalFuncName(std::string_view func_name) {
     GlobalDef def;
     
     def.value.resize(func_name.size());
@@ -69,7 +75,7 @@ void ProgramBinary::AddGlobalFuncName(const std::string &func_name) {
     globals.push_back(std::move(def));
 }
 
-void ProgramBinary::AddFuncDef(const std::string &func_name, Ptr<FuncDef> func) {
+void ProgramBinary::AddFuncDef(Symbol func_name, Ptr<FuncDef> func) {
     Function fn;
     fn.def = func.get();
     fn.offset = functions.size();
@@ -79,9 +85,11 @@ void ProgramBinary::AddFuncDef(const std::string &func_name, Ptr<FuncDef> func)
     function_map.emplace(func_name, fn);
 
     fn.def->name = globals.size();
-    AddGlobalFuncName(func_name);
+    AddGlobalFuncName(SymbolName(func_name));
 }
 
+// A block with a branch ends with it, and the VM adds the offset to the
+// index of the instruction after the branch.
 void FuncDef::CalculateJmpOffset() {
     num_insts = 0;
 
@@ -93,35 +101,324 @@ void FuncDef::CalculateJmpOffset() {
     for (const auto &block : body) {
         if (block->br) {
             BasicBlock *br = block->br;
-            block->instructions.back().PackInt32Param(br->offset - block->offset - 1);
+            const int next = block->offset + block->instructions.size();
+            block->instructions.back().PackInt32Param(br->offset - next);
         }
     }
 }
 
-void FuncDef::AddLocalVar(const std::string &name, VarType type, VarScope scope) {
-    Variable var;
-    var.type = type;
+Compiler::Compiler(std::ostream &out) : out_(out) {
+}
 
-    if (scope == kLocal) {
-        var.offset = loc_slots;
-        ++loc_slots;
-    } else {
-        var.offset = return_slots + param_slots;
-        ++param_slots;
+Compiler::Compiler(WorkerTag, const Compiler &parent) : out_(parent.out_), program_(parent.program_) {
+}
+
+void Compiler::Compile(ProgramNode *program) {
+    for (const auto &var : program->global_vars) {
+        AllocateGlobal(var);
+    }
+    for (const auto &func : program->functions) {
+        AllocateFunc(func);
+    }
+    Generate(program);
+}
+
+// A global with a constant initializer gets its value in the binary, and
+// only the others are initialized by _start.
+void Compiler::AllocateGlobal(DeclStmtNode *var) {
+    program_->AddGlobalVar();
+    if (IsStaticInit(var)) {
+        program_->SetGlobalValue(program_->globals.size() - 1, var->initializer->type.int_value,
+                                 var->is_const);
     }
-    local_vars.emplace(name, var);
+}
 
+void Compiler::AllocateFunc(FuncDefNode *node) {
+    Ptr<FuncDef> func = NewFuncDef(node->return_type, node->params.size());
+    AllocateLocals(node, func.get());
+    program_->AddFuncDef(node->name, std::move(func));
 }
 
-Compiler::Compiler(std::ostream &out) : out_(out) {
+void Compiler::BeginStream(Span<FuncDefNode *> functions) {
+    DeclareFunctions(functions);
+    AddStartFunc();
+    WriteHeader();
 }
 
-void Compiler::Compile(ProgramNode *program) {
-    phase_ = kVarAlloc;
-    program->Accept(*this);
-    phase_ = kCodeGen;
-    program->Accept(*this);
+void Compiler::StreamFunc(FuncDefNode *node) {
+    GenFunction(node);
+
+    FuncDef *func = program_->function_map.at(node->name).def;
+    WriteFunc(*func);
+    func->body = PtrVec<BasicBlock>();
+}
+
+// _start comes last, after the functions.
+void Compiler::EndStream(ProgramNode *program) {
+    GenStartFunc(program);
+    WriteFunc(*program_->functions.back());
+}
+
+void Compiler::DeclareFunctions(Span<FuncDefNode *> functions) {
+    for (const auto &func : functions) {
+        program_->AddFuncDef(func->name, NewFuncDef(func->return_type, func->params.size()));
+    }
+}
+
+void Compiler::GenFunction(FuncDefNode *node) {
+    AllocateLocals(node, program_->function_map.at(node->name).def);
+    Walk(node);
+}
+
+Ptr<FuncDef> Compiler::NewFuncDef(VarType return_type, uint32_t num_params) {
+    auto func = MakePtr<FuncDef>();
+
+    // Handle return value.
+    if (return_type != kVoid) {
+        func->return_slots = 1;
+    }
+
+    func->param_slots = num_params;
+    return func;
+}
+
+void Compiler::AllocateLocals(FuncDefNode *node, FuncDef *func) {
+    func->loc_slots = node->num_locals;
+}
+
+// A front end that folds the program after allocating it leaves globals
+// constant that got no value then.
+void Compiler::Generate(ProgramNode *program) {
+    for (const auto &var : program->global_vars) {
+        if (IsStaticInit(var))
+            program_->SetGlobalValue(var->slot, var->initializer->type.int_value, var->is_const);
+    }
+
+    AddStartFunc();
+    Walk(program);
+    GenerateCode();
+}
+
+size_t Compiler::NumInstructions() const {
+    size_t n = 0;
+    for (const auto &func : program_->functions) {
+        for (const auto &block : func->body) {
+            n += block->instructions.size();
+        }
+    }
+    return n;
+}
+
+void Compiler::Compile(FlatAst &ast) {
+    flat_ = &ast;
+
+    // Allocate variables, with the literal initializers in place.
+    for (const FlatStmt &var : ast.globals) {
+        program_->AddGlobalVar();
+        if (IsFlatLiteral(var.b)) {
+            const uint64_t value = ast.literals[ast.exprs[var.b].value];
+            program_->SetGlobalValue(program_->globals.size() - 1, value, var.is_const);
+        }
+    }
+
+    for (const FlatFunc &node : ast.functions) {
+        Ptr<FuncDef> func = NewFuncDef(node.return_type, node.num_params);
+        func->loc_slots = node.num_locals;
+        program_->AddFuncDef(node.name, std::move(func));
+    }
+    AddStartFunc();
+
+    // Generate code.
+    codes_ = MakePtr<BasicBlock>();
+    for (const FlatStmt &var : ast.globals) {
+        if (var.b == kFlatNone || IsFlatLiteral(var.b))
+            continue;
+
+        PushVarAddr(kGlobal, var.a);
+        StoreFlatExpr(var.b);
+    }
+    EndStartFunc();
+
+    for (const FlatFunc &node : ast.functions) {
+        BeginFunction(node.name);
+        GenFlatStmt(node.body);
+        EndFunction();
+    }
+
     GenerateCode();
+    flat_ = nullptr;
+}
+
+bool Compiler::IsFlatLiteral(uint32_t expr) const {
+    if (expr == kFlatNone)
+        return false;
+
+    const FlatExprKind kind = flat_->exprs[expr].kind;
+    return kind == kFlatIntLiteral || kind == kFlatDoubleLiteral;
+}
+
+void Compiler::GenFlatStmt(uint32_t index) {
+    const FlatStmt &stmt = flat_->stmts[index];
+
+    switch (stmt.kind) {
+    case kFlatDecl:
+        if (stmt.b != kFlatNone) {
+            PushVarAddr(kLocal, stmt.a);
+            StoreFlatExpr(stmt.b);
+        }
+        break;
+    case kFlatExprStmt:
+        GenFlatExpr(stmt.a);
+        break;
+    case kFlatReturn:
+        if (stmt.a != kFlatNone) {
+            GenCodeU32(kOpCodeArga, 0);
+            StoreFlatExpr(stmt.a);
+        }
+        Ret();
+        break;
+    case kFlatBlock:
+        for (uint32_t i = index + 1; i < stmt.b; i = flat_->End(i)) {
+            GenFlatStmt(i);
+        }
+        break;
+    case kFlatIf: {
+        auto next = MakePtr<BasicBlock>();
+        auto end = MakePtr<BasicBlock>();
+
+        GenFlatCondBody(stmt.a, index + 1, next.get(), end.get());
+
+        uint32_t i = flat_->End(index + 1);
+        for (; i < stmt.b && flat_->stmts[i].kind == kFlatElseIf; i = flat_->End(i)) {
+            SwitchToBlock(std::move(next));
+            next = MakePtr<BasicBlock>();
+            GenFlatCondBody(flat_->stmts[i].a, i + 1, next.get(), end.get());
+        }
+
+        SwitchToBlock(std::move(next));
+
+        // The else part.
+        if (i < stmt.b) {
+            GenFlatStmt(i);
+        }
+
+        SwitchToBlock(std::move(end));
+        break;
+    }
+    case kFlatWhile: {
+        CreateNewCodeBlock();
+        auto cond_block = codes_.get();
+        GenFlatExpr(stmt.a);
+        Branch(kOpCodeBrFalse, nullptr);
+
+        CreateNewCodeBlock();
+        GenFlatStmt(index + 1);
+        Branch(kOpCodeBr, cond_block);
+
+        CreateNewCodeBlock();
+        cond_block->br = codes_.get();
+        break;
+    }
+    case kFlatElseIf:
+        break;
+    }
+}
+
+void Compiler::GenFlatCondBody(uint32_t condition, uint32_t body, BasicBlock *next, BasicBlock *end) {
+    GenFlatExpr(condition);
+    Branch(kOpCodeBrFalse, next);
+
+    CreateNewCodeBlock();
+    GenFlatStmt(body);
+    Branch(kOpCodeBr, end);
+}
+
+// Like GenExpr(), with steps that return kFlatNone once the expression is
+// done.
+void Compiler::GenFlatExpr(uint32_t root) {
+    const size_t base = flat_expr_stack_.size();
+    flat_expr_stack_.push_back({root, 0, 0});
+
+    while (flat_expr_stack_.size() > base) {
+        FlatExprFrame &frame = flat_expr_stack_.back();
+        const uint32_t child = GenFlatStep(frame);
+
+        if (child == kFlatNone) {
+            flat_expr_stack_.pop_back();
+        } else {
+            ++frame.next_child;
+            flat_expr_stack_.push_back({child, 0, 0});
+        }
+    }
+}
+
+uint32_t Compiler::GenFlatStep(FlatExprFrame &frame) {
+    const uint32_t index = frame.expr;
+    const uint32_t step = frame.next_child;
+    const FlatExpr &expr = flat_->exprs[index];
+    const VarType type = VarType(expr.type);
+
+    switch (expr.kind) {
+    case kFlatIntLiteral:
+        PushInt(static_cast<int64_t>(flat_->literals[expr.value]));
+        break;
+    case kFlatDoubleLiteral: {
+        double value;
+        memcpy(&value, &flat_->literals[expr.value], sizeof(value));
+        PushDouble(value);
+        break;
+    }
+    case kFlatIdent:
+        PushVarAddr(VarScope(expr.op), expr.value);
+        GenCode(kOpCodeLoad64);
+        break;
+    case kFlatAssign:
+        if (step == 0) {
+            PushVarAddr(VarScope(expr.op), expr.value);
+            return index - 1;
+        }
+        GenCode(kOpCodeStore64);
+        break;
+    case kFlatNegate:
+        if (step == 0)
+            return index - 1;
+
+        Neg(type);
+        break;
+    case kFlatOperator:
+        if (step == 0)
+            return flat_->Previous(index - 1);
+        if (step == 1)
+            return index - 1;
+
+        GenOperator(TokenType(expr.op), type);
+        break;
+    case kFlatCall: {
+        // As in GenStep(), with the roots of the arguments collected going
+        // backwards from the call, like TypeChecker::CheckStep() does.
+        const Function &func = program_->function_map.at(expr.value);
+        if (frame.next_child == 0) {
+            frame.first_arg = flat_arg_stack_.size();
+            for (uint32_t end = index; end > expr.first; end = flat_->exprs[end - 1].first) {
+                flat_arg_stack_.push_back(end - 1);
+            }
+            std::reverse(flat_arg_stack_.begin() + frame.first_arg, flat_arg_stack_.end());
+            StackAlloc(func.has_return ? 1 : 0);
+        }
+        if (frame.first_arg + frame.next_child < flat_arg_stack_.size())
+            return flat_arg_stack_[frame.first_arg + frame.next_child];
+
+        flat_arg_stack_.resize(frame.first_arg);
+        Call(func);
+        break;
+    }
+    }
+    return kFlatNone;
+}
+
+void Compiler::StoreFlatExpr(uint32_t expr) {
+    GenFlatExpr(expr);
+    GenCode(kOpCodeStore64);
 }
 
 void Compiler::WriteByte(uint8_t x) {
@@ -141,11 +438,20 @@ void Compiler::WriteLit64(uint64_t value) {
 // templateWriteArray
 
 void Compiler::GenerateCode() {
+    WriteHeader();
+    for (const auto &func : program_->functions) {
+        WriteFunc(*func);
+    }
+}
+
+// The globals, which include the names of all functions, and the number of
+// functions, which follow.
+void Compiler::WriteHeader() {
     WriteLit32(0x72303b3eul);
     WriteLit32(0x1ul);
-    WriteLit32(program_.globals.size());
+    WriteLit32(program_->globals.size());
 
-    for (const auto &global : program_.globals) {
+    for (const auto &global : program_->globals) {
         WriteByte(global.is_const);
         WriteLit32(global.value.size());
         for (uint8_t byte : global.value) {
@@ -153,37 +459,35 @@ void Compiler::GenerateCode() {
         }
     }
 
-    WriteLit32(program_.functions.size());
+    WriteLit32(program_->functions.size());
+}
 
-    for (const auto &func : program_.functions) {
-        WriteLit32(func->name);
-        WriteLit32(func->return_slots);
-        WriteLit32(func->param_slots);
-        WriteLit32(func->loc_slots);
-        WriteLit32(func->num_insts);
+void Compiler::WriteFunc(const FuncDef &func) {
+    WriteLit32(func.name);
+    WriteLit32(func.return_slots);
+    WriteLit32(func.param_slots);
+    WriteLit32(func.loc_slots);
+    WriteLit32(func.num_insts);
 
-        for (const auto &block : func->body) {
-            for (const auto &inst : block->instructions) {
-                WriteByte(inst.opcode);
-                if (inst.param_size == 32) {
-                    WriteLit32(inst.param);
-                } else {
-                    WriteLit64(inst.param);
-                }
-            }            
+    for (const auto &block : func.body) {
+        for (const auto &inst : block->instructions) {
+            WriteByte(inst.opcode);
+            if (inst.param_size == 32) {
+                WriteLit32(inst.param);
+            } else {
+                WriteLit64(inst.param);
+            }
         }
     }
 }
 
 void Compiler::GenCondBody(CondBody &cond_body, BasicBlock *next, BasicBlock *end) {
-    cond_body.condition->Accept(*this);
-    GenCodeU32(kOpCodeBrFalse, 0);
-    codes_->br = next;
+    Walk(cond_body.condition);
+    Branch(kOpCodeBrFalse, next);
 
     CreateNewCodeBlock();
-    cond_body.body->Accept(*this);
-    GenCodeU32(kOpCodeBr, 0);
-    codes_->br = end;
+    Walk(cond_body.body);
+    Branch(kOpCodeBr, end);
 }
 
 void Compiler::CreateNewCodeBlock() {
@@ -192,256 +496,269 @@ void Compiler::CreateNewCodeBlock() {
     codes_ = MakePtr<BasicBlock>();
 }
 
+// The current block is complete, code goes to `block` from now on.
+void Compiler::SwitchToBlock(Ptr<BasicBlock> block) {
+    func_->body.push_back(std::move(codes_));
+    codes_ = std::move(block);
+}
+
+// A branch to `target`, or to a block that is set once it exists.
+void Compiler::Branch(OpCode opcode, BasicBlock *target) {
+    GenCodeU32(opcode, 0);
+    codes_->br = target;
+}
+
 void Compiler::AddStartFunc() {
     auto func = MakePtr<FuncDef>();
-    program_.AddFuncDef("_start", std::move(func));
+    program_->AddFuncDef(Interner::Global().Intern("_start"), std::move(func));
 }
 
 void Compiler::GenStartFunc(ProgramNode *node) {
     codes_ = MakePtr<BasicBlock>();
 
     for (const auto &var : node->global_vars) {
-        if (!var->initializer)
+        if (!var->initializer || IsStaticInit(var))
             continue;
 
-        AssignToVar(var->name, var->initializer.get());
+        AssignToVar(var, var->initializer);
     }
+    EndStartFunc();
+}
 
-    auto func = program_.function_map.at("_start").def;
+void Compiler::EndStartFunc() {
+    auto func = program_->function_map.at(Interner::Global().Intern("_start")).def;
     func->body.push_back(std::move(codes_));
+    func->CalculateJmpOffset();
+}
+
+void Compiler::BeginFunction(Symbol name) {
+    func_ = program_->function_map.at(name).def;
+    codes_ = MakePtr<BasicBlock>();
+}
+
+// A function that can reach its end returns there.
+void Compiler::EndFunction() {
+    if (codes_->instructions.empty() || codes_->instructions.back().opcode != kOpCodeRet) {
+        GenCode(kOpCodeRet);
+    }
+
+    func_->body.push_back(std::move(codes_));
+    func_->CalculateJmpOffset();
+
+    func_ = nullptr;
+}
+
+// The initializer is a literal, or was folded by the ConstFolder.
+bool Compiler::IsStaticInit(const DeclStmtNode *var) {
+    return var->initializer && var->initializer->type.is_const;
 }
 
 void Compiler::Visit(ProgramNode *node) {
-    if (phase_ == kVarAlloc) {
-        for (const auto &var : node->global_vars) {
-            program_.AddGlobalVar(var->name, var->type);
-        }
+    GenStartFunc(node);
+    if (num_threads_ > 1) {
+        GenFunctionsParallel(node->functions);
+        return;
+    }
 
-        for (const auto &func : node->functions) {
-            func->Accept(*this);
-        }
-        AddStartFunc();
-    } else {
-        GenStartFunc(node);
-        for (const auto &func : node->functions) {
-            func->Accept(*this);
-        }
+    for (const auto &func : node->functions) {
+        Walk(func);
     }
 }
 
-void Compiler::Visit(ExprStmtNode *node) {
-    if (phase_ != kCodeGen)
+// Every function already has its FuncDef, and generating its code only
+// reads the global and function maps, so functions can be generated at the
+// same time. Chunks of consecutive functions go to workers with a codes_
+// and func_ of their own, and the output does not depend on their order.
+void Compiler::GenFunctionsParallel(Span<FuncDefNode *> functions) {
+    const size_t num_chunks = std::min<size_t>(functions.size(), num_threads_ * 4);
+    if (num_chunks == 0)
         return;
-    node->expr->Accept(*this);
+
+    ThreadPool pool(std::min<size_t>(num_threads_, num_chunks));
+    for (size_t i = 0; i < num_chunks; ++i) {
+        const size_t first = functions.size() * i / num_chunks;
+        const size_t last = functions.size() * (i + 1) / num_chunks;
+        pool.Submit([this, functions, first, last] {
+            Compiler worker(WorkerTag(), *this);
+            for (size_t fn = first; fn < last; ++fn) {
+                worker.Walk(functions[fn]);
+            }
+        });
+    }
+    pool.Wait();
+}
+
+void Compiler::Visit(ExprStmtNode *node) {
+    Walk(node->expr);
 }
 
 void Compiler::Visit(DeclStmtNode *node) {
-    if (phase_ == kVarAlloc) {
-        if (func_) {
-            func_->AddLocalVar(node->name, node->type, kLocal);
-        }
-    } else {
-        if (node->initializer) {
-            AssignToVar(node->name, node->initializer.get());
-        }
+    if (node->initializer) {
+        AssignToVar(node, node->initializer);
     }
 }
 
 void Compiler::Visit(IfStmtNode *node) {
-    if (phase_ != kCodeGen)
-        return;
-
     auto next = MakePtr<BasicBlock>();
     auto end = MakePtr<BasicBlock>();
 
     GenCondBody(node->if_part, next.get(), end.get());
 
     for (auto &cond_body : node->elif_part) {
-        func_->body.push_back(std::move(codes_));
-        codes_ = std::move(next);
+        SwitchToBlock(std::move(next));
         next = MakePtr<BasicBlock>();
         GenCondBody(cond_body, next.get(), end.get());
     }
 
-    func_->body.push_back(std::move(codes_));
-    codes_ = std::move(next);
+    SwitchToBlock(std::move(next));
 
     if (node->else_part) {
-        node->else_part->Accept(*this);
+        Walk(node->else_part);
     }
 
-    func_->body.push_back(std::move(codes_));
-    codes_ = std::move(end);
+    SwitchToBlock(std::move(end));
 }
 
 void Compiler::Visit(WhileStmtNode *node) {
-    if (phase_ != kCodeGen)
-        return;
-
     CreateNewCodeBlock();
     auto cond_block = codes_.get();
-    node->condition->Accept(*this);
-    GenCodeU32(kOpCodeBrFalse, 0);
+    Walk(node->condition);
+    Branch(kOpCodeBrFalse, nullptr);
 
     CreateNewCodeBlock();
-    node->body->Accept(*this);
-    GenCodeU32(kOpCodeBr, 0);
-    codes_->br = cond_block;
+    Walk(node->body);
+    Branch(kOpCodeBr, cond_block);
 
     CreateNewCodeBlock();
     cond_block->br = codes_.get();
 }
 
 void Compiler::Visit(ReturnStmtNode *node) {
-    if (phase_ != kCodeGen)
-        return;
-
     if (node->expr) {
         GenCodeU32(kOpCodeArga, 0);
-        StoreExpr(node->expr.get());
+        StoreExpr(node->expr);
     }
     Ret();
 }
 
 void Compiler::Visit(BlockStmtNode *node) {
-    if (phase_ != kCodeGen)
-        return;
     for (const auto &stmt : node->statements) {
-        stmt->Accept(*this);
+        Walk(stmt);
     }
 }
 
 void Compiler::Visit(OperatorExprNode *node) {
-    node->left->Accept(*this);
-    node->right->Accept(*this);
-
-    switch (node->op) {
-    case kMul:
-        Mul(node->type.type);
-        break;
-    case kDiv:
-        Div(node->type.type);
-        break;
-    case kMinus:
-        Sub(node->type.type);
-        break;
-    case kPlus:
-        Add(node->type.type);
-        break;
-    case kGt:
-        Gt(node->type.type);
-        break;
-    case kLt:
-        Lt(node->type.type);
-        break;
-    case kGe:
-        Ge(node->type.type);
-        break;
-    case kLe:
-        Le(node->type.type);
-        break;
-    case kEq:
-        Eq(node->type.type);
-        break;
-    case kNeq:
-        Neq(node->type.type);
-        break;
-    default:
-        break;
-    }
+    GenExpr(node);
 }
 
 void Compiler::Visit(NegateExpr *node) {
-    node->operand->Accept(*this);
-    if (node->type.type == kInt) {
-        GenCode(kOpCodeNegI);
-    } else {
-        GenCode(kOpCodeNegF);
-    }
+    GenExpr(node);
 }
 
 void Compiler::Visit(AssignExprNode *node) {
-    AssignToVar(node->lhs, node->rhs.get());
+    GenExpr(node);
 }
 
 void Compiler::Visit(CallExprNode *node) {
-    const Function &func = program_.function_map.at(node->func_name);
-    if (func.has_return) {
-        StackAlloc(1 + node->args.size());
-    } else {
-        StackAlloc(node->args.size());
-    }
-
-    if (func.def == nullptr) {
-        GenCodeU32(kOpCodeCallname, func.offset);
-    } else {
-        GenCodeU32(kOpCodeCall, func.offset);
-    }
+    GenExpr(node);
 }
 
 void Compiler::Visit(LiteralExprNode *node) {
-    if (node->type.type == kInt) {
-        PushInt(strtoll(node->lexeme.c_str(), nullptr, 10));
-    } else {
-        PushDouble(strtod(node->lexeme.c_str(), nullptr));
-    }
+    GenExpr(node);
 }
 
 void Compiler::Visit(IdentExprNode *node) {
-    PushVarAddr(node->var_name);
-    GenCode(kOpCodeLoad64);
+    GenExpr(node);
 }
 
-void Compiler::Visit(FuncDefNode *node) {
-    if (phase_ == kVarAlloc) {
-        auto func = MakePtr<FuncDef>();
-        func_ = func.get();
+// Like TypeChecker::CheckExpr(), walks the expression with expr_stack_ and
+// generates the code of a node in steps.
+void Compiler::GenExpr(ExprNode *root) {
+    const size_t base = expr_stack_.size();
+    expr_stack_.push_back({root, 0});
 
-        // Handle return value.
-        if (node->return_type != kVoid) {
-            func->return_slots = 1;
-        }
+    while (expr_stack_.size() > base) {
+        ExprFrame &frame = expr_stack_.back();
+        ExprNode *child = GenStep(frame.node, frame.next_child);
 
-        // Handle parameters.
-        for (const auto &param : node->params) {
-            func->AddLocalVar(param->name, param->type, kParam);
+        if (child == nullptr) {
+            expr_stack_.pop_back();
+        } else {
+            ++frame.next_child;
+            expr_stack_.push_back({child, 0});
         }
+    }
+}
 
-        // Allocate space for local variables.
-        for (const auto &stmt : node->body->statements) {
-            stmt->Accept(*this);
+ExprNode *Compiler::GenStep(ExprNode *expr, uint32_t step) {
+    // A literal, or an expression that the ConstFolder worked out.
+    if (expr->type.is_const) {
+        if (expr->type.type == kDouble) {
+            PushDouble(expr->type.double_value);
+        } else {
+            PushInt(expr->type.int_value);
         }
+        return nullptr;
+    }
 
-        program_.AddFuncDef(node->name, std::move(func));
-        func_ = nullptr;
-    } else {
-        const Function &func = program_.function_map.at(node->name);
-        func_ = func.def;
-        codes_ = MakePtr<BasicBlock>();
-        node->body->Accept(*this);
-
-        if (codes_->instructions.empty() || codes_->instructions.back().opcode != kOpCodeRet) {
-            GenCode(kOpCodeRet);
-        }
+    switch (expr->kind) {
+    case kOperatorExprNode: {
+        auto node = static_cast<OperatorExprNode *>(expr);
+        if (step == 0)
+            return node->left;
+        if (step == 1)
+            return node->right;
 
-        func_->body.push_back(std::move(codes_));
-
-        func_ = nullptr;
+        GenOperator(node->op, node->type.type);
+        break;
     }
-}
-
+    case kNegateExpr: {
+        auto node = static_cast<NegateExpr *>(expr);
+        if (step == 0)
+            return node->operand;
 
-const Variable &Compiler::LookUpVar(const std::string &name) {
-    if (func_) {
-        auto it = func_->local_vars.find(name);
-        if (it != func_->local_vars.end()) {
-            return it->second;
+        Neg(node->type.type);
+        break;
+    }
+    case kAssignExprNode: {
+        auto node = static_cast<AssignExprNode *>(expr);
+        if (step == 0) {
+            PushVarAddr(node->decl);
+            return node->rhs;
         }
+        GenCode(kOpCodeStore64);
+        break;
+    }
+    case kCallExprNode: {
+        // The return slot, then each argument is pushed into the slot of its
+        // parameter.
+        auto node = static_cast<CallExprNode *>(expr);
+        const Function &func = program_->function_map.at(node->func_name);
+        if (step == 0)
+            StackAlloc(func.has_return ? 1 : 0);
+        if (step < node->args.size())
+            return node->args[step];
+
+        Call(func);
+        break;
+    }
+    case kIdentExprNode:
+        PushVarAddr(static_cast<IdentExprNode *>(expr)->decl);
+        GenCode(kOpCodeLoad64);
+        break;
+    default:
+        break;
     }
+    return nullptr;
+}
 
-    return program_.global_vars.at(name);
+void Compiler::Visit(FuncDefNode *node) {
+    BeginFunction(node->name);
+    Walk(node->body);
+    EndFunction();
 }
 
+
 void Compiler::PushInt(int64_t x) {
     GenCodeU64(kOpCodePush, static_cast<uint64_t>(x));
 }
@@ -451,25 +768,27 @@ void Compiler::PushDouble(double x) {
     GenCodeU64(kOpCodePush, v);
 }
 
-void Compiler::PushVarAddr(const std::string &name) {
-    const Variable &var = LookUpVar(name);
-    if (var.scope == kLocal) {
-        GenCodeU32(kOpCodeLoca, var.offset);
-    } else if (var.scope == kGlobal) {
-        GenCodeU32(kOpCodeGloba, var.offset);
+void Compiler::PushVarAddr(VarScope scope, uint32_t slot) {
+    if (scope == kLocal) {
+        GenCodeU32(kOpCodeLoca, slot);
+    } else if (scope == kGlobal) {
+        GenCodeU32(kOpCodeGloba, slot);
     } else {
-        // This is a function parameter.
-        GenCodeU32(kOpCodeArga, var.offset);
+        GenCodeU32(kOpCodeArga, func_->return_slots + slot);
     }
 }
 
-void Compiler::AssignToVar(const std::string &name, ExprNode *expr) {
-    PushVarAddr(name);
+void Compiler::PushVarAddr(const DeclStmtNode *var) {
+    PushVarAddr(var->scope, var->slot);
+}
+
+void Compiler::AssignToVar(const DeclStmtNode *var, ExprNode *expr) {
+    PushVarAddr(var);
     StoreExpr(expr);
 }
 
 void Compiler::StoreExpr(ExprNode *expr) {
-    expr->Accept(*this);
+    Walk(expr);
     GenCode(kOpCodeStore64);
 }
 
@@ -583,6 +902,60 @@ void Compiler::Compare(VarType type) {
     }
 }
 
+void Compiler::Neg(VarType type) {
+    if (type == kInt) {
+        GenCode(kOpCodeNegI);
+    } else {
+        GenCode(kOpCodeNegF);
+    }
+}
+
+void Compiler::GenOperator(TokenType op, VarType type) {
+    switch (op) {
+    case kMul:
+        Mul(type);
+        break;
+    case kDiv:
+        Div(type);
+        break;
+    case kMinus:
+        Sub(type);
+        break;
+    case kPlus:
+        Add(type);
+        break;
+    case kGt:
+        Gt(type);
+        break;
+    case kLt:
+        Lt(type);
+        break;
+    case kGe:
+        Ge(type);
+        break;
+    case kLe:
+        Le(type);
+        break;
+    case kEq:
+        Eq(type);
+        break;
+    case kNeq:
+        Neq(type);
+        break;
+    default:
+        break;
+    }
+}
+
+// A builtin function has no FuncDef and is called by name.
+void Compiler::Call(const Function &func) {
+    if (func.def == nullptr) {
+        GenCodeU32(kOpCodeCallname, func.offset);
+    } else {
+        GenCodeU32(kOpCodeCall, func.offset);
+    }
+}
+
 void Compiler::StackAlloc(uint32_t n) {
     GenCodeU32(kOpCodeStackalloc, n);
 }
@@ -3,25 +3,15 @@
 
 #include <vector>
 #include <map>
+#include <string_view>
 
 #include "ast.h"
+#include "flat_ast.h"
 #include "opcode.h"
 
 template <typename T>
 using Array = std::vector<T>;
 
-enum VarScope {
-    kLocal,
-    kGlobal,
-    kParam,
-};
-
-struct Variable {
-    VarScope scope;
-    VarType type;
-    int32_t offset;
-};
-
 struct GlobalDef {
     uint8_t is_const = 0;
     Array<uint8_t> value;
@@ -50,12 +40,9 @@ struct FuncDef {
     uint32_t loc_slots = 0;
     uint32_t num_insts = 0;
 
-    std::map<std::string, Variable> local_vars;
     PtrVec<BasicBlock> body;
 
     void CalculateJmpOffset();
-
-    void AddLocalVar(const std::string &name, VarType type, VarScope scope);
 };
 
 struct Function {
@@ -68,57 +55,119 @@ struct ProgramBinary {
     Array<GlobalDef> globals;
     PtrVec<FuncDef> functions;
 
-    void AddGlobalVar(const std::string &name, VarType type);
-    void AddFuncDef(const std::string &func_name, Ptr<FuncDef> func);
+    void AddGlobalVar();
+    void SetGlobalValue(uint32_t offset, uint64_t value, bool is_const);
+    void AddFuncDef(Symbol func_name, Ptr<FuncDef> func);
 
-    std::map<std::string, Variable> global_vars;
-    std::map<std::string, Function> function_map;
+    std::map<Symbol, Function> function_map;
 
 private:
-    void AddGlobalFuncName(const std::string &func_name);
+    void AddGlobalFuncName(std::string_view func_name);
 };
 
-class Compiler : public AstVisitor {
+class Compiler : private AstWalker<Compiler> {
 public:
     Compiler(std::ostream &out);
+    Compiler(const Compiler &) = delete;
+    Compiler &operator=(const Compiler &) = delete;
+
     void Compile(ProgramNode *program);
 
+    // Compile() in steps, for a front end that allocates each part of the
+    // program as soon as it is parsed: AllocateGlobal() and AllocateFunc()
+    // in program order, then Generate() once the whole program is there.
+    void AllocateGlobal(DeclStmtNode *var);
+    void AllocateFunc(FuncDefNode *node);
+    void Generate(ProgramNode *program);
+
+    // Compile() for a front end that writes each function as soon as it is
+    // parsed and only keeps its header after: AllocateGlobal() on each
+    // global variable, BeginStream() with the signatures of all functions,
+    // StreamFunc() on each function in order, then EndStream().
+    void BeginStream(Span<FuncDefNode *> functions);
+    void StreamFunc(FuncDefNode *node);
+    void EndStream(ProgramNode *program);
+
+    // Compile a flattened program that went through TypeChecker::Check().
+    void Compile(FlatAst &ast);
+
+    // Generate the code of the functions of a ProgramNode on this many
+    // threads. The output is the same for any number.
+    void SetThreads(unsigned num_threads) { num_threads_ = num_threads; }
+
+    // Number of instructions of the functions that are still kept, for
+    // statistics.
+    size_t NumInstructions() const;
+
 private:
-    void Visit(ProgramNode *node) override;
-    void Visit(ExprStmtNode *node) override;
-    void Visit(DeclStmtNode *node) override;
-    void Visit(IfStmtNode *node) override;
-    void Visit(WhileStmtNode *node) override;
-    void Visit(ReturnStmtNode *node) override;
-    void Visit(BlockStmtNode *node) override;
-    void Visit(OperatorExprNode *node) override;
-    void Visit(NegateExpr *node) override;
-    void Visit(AssignExprNode *node) override;
-    void Visit(CallExprNode *node) override;
-    void Visit(LiteralExprNode *node) override;
-    void Visit(IdentExprNode *node) override;
-    void Visit(FuncDefNode *node) override;
+    friend class AstWalker<Compiler>;
+    friend class Pipeline;
+
+    // Picks the constructor of a worker, which is no copy of its parent.
+    struct WorkerTag {};
+
+    // A compiler for GenFunctionsParallel() and the Pipeline that generates
+    // code into the functions of `parent`.
+    Compiler(WorkerTag, const Compiler &parent);
+
+    void GenFunctionsParallel(Span<FuncDefNode *> functions);
+
+    // AllocateFunc() in two steps for the Pipeline: DeclareFunctions() with
+    // the signatures of all functions after the global variables, then
+    // GenFunction() on each function, from any thread.
+    void DeclareFunctions(Span<FuncDefNode *> functions);
+    void GenFunction(FuncDefNode *node);
+    Ptr<FuncDef> NewFuncDef(VarType return_type, uint32_t num_params);
+    void AllocateLocals(FuncDefNode *node, FuncDef *func);
+
+    // Code generation, run by Walk() once all slots are allocated. Variables
+    // are addressed by the slots that the TypeChecker gave them.
+    void Visit(ProgramNode *node);
+    void Visit(ExprStmtNode *node);
+    void Visit(DeclStmtNode *node);
+    void Visit(IfStmtNode *node);
+    void Visit(WhileStmtNode *node);
+    void Visit(ReturnStmtNode *node);
+    void Visit(BlockStmtNode *node);
+    void Visit(OperatorExprNode *node);
+    void Visit(NegateExpr *node);
+    void Visit(AssignExprNode *node);
+    void Visit(CallExprNode *node);
+    void Visit(LiteralExprNode *node);
+    void Visit(IdentExprNode *node);
+    void Visit(FuncDefNode *node);
 
 private:
-    enum Phase {
-        kVarAlloc,
-        kCodeGen,
+    // An expression being generated by GenExpr().
+    struct ExprFrame {
+        ExprNode *node;
+        uint32_t next_child;        // Number of steps done.
     };
 
-private:
+    void GenExpr(ExprNode *root);
+    ExprNode *GenStep(ExprNode *expr, uint32_t step);
+
     void WriteByte(uint8_t);
     void WriteLit32(uint32_t value);
     void WriteLit64(uint64_t value);
     void GenerateCode();
+    void WriteHeader();
+    void WriteFunc(const FuncDef &func);
     void GenCondBody(CondBody &cond_body, BasicBlock *next, BasicBlock *end);
     void CreateNewCodeBlock();
+    void SwitchToBlock(Ptr<BasicBlock> block);
+    void Branch(OpCode opcode, BasicBlock *target);
     void AddStartFunc();
     void GenStartFunc(ProgramNode *node);
-    const Variable &LookUpVar(const std::string &name);
+    void EndStartFunc();
+    void BeginFunction(Symbol name);
+    void EndFunction();
+    static bool IsStaticInit(const DeclStmtNode *var);
     void PushInt(int64_t);
     void PushDouble(double);
-    void PushVarAddr(const std::string &name);
-    void AssignToVar(const std::string &name, ExprNode *expr);
+    void PushVarAddr(VarScope scope, uint32_t slot);
+    void PushVarAddr(const DeclStmtNode *var);
+    void AssignToVar(const DeclStmtNode *var, ExprNode *expr);
     void StoreExpr(ExprNode *expr);
     void Ret();
     void GenCode(OpCode opcode);
@@ -136,17 +185,39 @@ private:
     void Eq(VarType type);
     void Neq(VarType type);
     void Compare(VarType type);
+    void Neg(VarType type);
+    void GenOperator(TokenType op, VarType type);
+    void Call(const Function &func);
     void StackAlloc(uint32_t n);
 
+    void GenFlatStmt(uint32_t stmt);
+    void GenFlatCondBody(uint32_t condition, uint32_t body, BasicBlock *next, BasicBlock *end);
+    // An expression of a FlatAst being generated by GenFlatExpr().
+    struct FlatExprFrame {
+        uint32_t expr;
+        uint32_t next_child;        // Number of steps done.
+        uint32_t first_arg;         // The arguments of a call, in flat_arg_stack_.
+    };
+
+    void GenFlatExpr(uint32_t root);
+    uint32_t GenFlatStep(FlatExprFrame &frame);
+    void StoreFlatExpr(uint32_t expr);
+    bool IsFlatLiteral(uint32_t expr) const;
+
 private:
     std::ostream &out_;
-    FuncDef *func_;
-    ProgramBinary program_;
+    FuncDef *func_ = nullptr;
+    ProgramBinary binary_;
+    ProgramBinary *program_ = &binary_;     // binary_, or that of the parent.
+    unsigned num_threads_ = 1;
 
-    Phase phase_ = kVarAlloc;
+    const FlatAst *flat_ = nullptr;
 
     Ptr<BasicBlock> codes_;
     PtrVec<FuncDef> functions_;
+    std::vector<ExprFrame> expr_stack_;
+    std::vector<FlatExprFrame> flat_expr_stack_;
+    std::vector<uint32_t> flat_arg_stack_;  // Arguments of the calls being generated.
 };
 
 #endif // COMPILER_H
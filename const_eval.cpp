@@ -0,0 +1,356 @@
+#include "const_eval.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+void SetInt(ExprType &result, VarType type, uint64_t value) {
+    result.type = type;
+    result.is_const = true;
+    result.int_value = static_cast<int64_t>(value);
+}
+
+void SetDouble(ExprType &result, double value) {
+    result.type = kDouble;
+    result.is_const = true;
+    result.double_value = value;
+}
+
+// The bits of a value on the VM stack as a double, as cmp.f reads them.
+double AsDouble(const ExprType &type) {
+    double value;
+    memcpy(&value, &type.int_value, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+// Ints wrap around and doubles round as in IEEE 754, as in the VM. The VM
+// traps on an int division by zero and on the overflow of INT64_MIN / -1.
+// A comparison uses the cmp that Compiler::Compare() picks for the type of
+// the node, which leaves -1, 0 or 1, then turns that into a bool the way
+// Compiler::Lt() and the others do.
+bool EvalOperator(const OperatorExprNode *node, const ExprType &left, const ExprType &right,
+                  ExprType &result) {
+    const VarType type = node->type.type;
+    switch (node->op) {
+    case kPlus:
+    case kMinus:
+    case kMul:
+    case kDiv:
+        if (type == kInt) {
+            const uint64_t a = left.int_value;
+            const uint64_t b = right.int_value;
+            if (node->op == kPlus) {
+                SetInt(result, type, a + b);
+            } else if (node->op == kMinus) {
+                SetInt(result, type, a - b);
+            } else if (node->op == kMul) {
+                SetInt(result, type, a * b);
+            } else if (right.int_value != 0 &&
+                       !(left.int_value == std::numeric_limits<int64_t>::min() && right.int_value == -1)) {
+                SetInt(result, type, left.int_value / right.int_value);
+            } else {
+                return false;
+            }
+        } else {
+            const double a = left.double_value;
+            const double b = right.double_value;
+            if (node->op == kPlus) {
+                SetDouble(result, a + b);
+            } else if (node->op == kMinus) {
+                SetDouble(result, a - b);
+            } else if (node->op == kMul) {
+                SetDouble(result, a * b);
+            } else {
+                SetDouble(result, a / b);
+            }
+        }
+        return true;
+    default:
+        break;
+    }
+
+    int64_t cmp = 0;
+    if (type == kInt) {
+        cmp = (left.int_value > right.int_value) - (left.int_value < right.int_value);
+    } else {
+        // cmp.f on a NaN is left to the VM.
+        const double a = AsDouble(left);
+        const double b = AsDouble(right);
+        if (std::isnan(a) || std::isnan(b))
+            return false;
+        cmp = (a > b) - (a < b);
+    }
+
+    switch (node->op) {
+    case kLt:
+        SetInt(result, type, cmp < 0);
+        return true;
+    case kGt:
+        SetInt(result, type, cmp > 0);
+        return true;
+    case kLe:
+        SetInt(result, type, !(cmp > 0));
+        return true;
+    case kGe:
+        SetInt(result, type, !(cmp < 0));
+        return true;
+    case kEq:
+        SetInt(result, type, cmp == 0);
+        return true;
+    case kNeq:
+        SetInt(result, type, cmp);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool EvalNegate(const NegateExpr *node, const ExprType &operand, ExprType &result) {
+    if (node->type.type == kInt) {
+        SetInt(result, kInt, 0 - static_cast<uint64_t>(operand.int_value));
+    } else {
+        SetDouble(result, -operand.double_value);
+    }
+    return true;
+}
+
+bool ConstEvaluator::EvalCall(const CallExprNode *call, ExprType &result) {
+    const FuncDefNode *func = Definition(call->func);
+    if (func == nullptr || func->return_type == kVoid || total_steps_ >= kMaxTotalSteps)
+        return false;
+
+    std::vector<ExprType> args;
+    args.reserve(call->args.size());
+    for (const auto &arg : call->args) {
+        if (!arg->type.is_const)
+            return false;
+        args.push_back(arg->type);
+    }
+
+    values_.clear();
+    is_set_.clear();
+    frame_ = 0;
+    num_params_ = 0;
+    steps_ = 0;
+    call_depth_ = 0;
+    nesting_ = 0;
+    const bool ok = Call(func, args, result);
+    total_steps_ += steps_;
+    return ok;
+}
+
+void ConstEvaluator::SetFunctions(Span<FuncDefNode *> functions) {
+    functions_.clear();
+    for (const FuncDefNode *func : functions) {
+        functions_.emplace(func->name, func);
+    }
+}
+
+// Builtins have no definition, and stay as they are.
+const FuncDefNode *ConstEvaluator::Definition(const FuncDefNode *func) const {
+    if (func == nullptr || func->body != nullptr)
+        return func;
+
+    auto it = functions_.find(func->name);
+    return it != functions_.end() ? it->second : func;
+}
+
+bool ConstEvaluator::Call(const FuncDefNode *func, const std::vector<ExprType> &args, ExprType &result) {
+    // Builtins have no body.
+    if (func->body == nullptr || call_depth_ == kMaxCallDepth)
+        return false;
+
+    const size_t caller_frame = frame_;
+    const size_t caller_num_params = num_params_;
+    frame_ = values_.size();
+    num_params_ = args.size();
+    values_.insert(values_.end(), args.begin(), args.end());
+    values_.resize(frame_ + num_params_ + func->num_locals);
+    is_set_.resize(frame_ + num_params_, true);
+    is_set_.resize(values_.size(), false);
+
+    ++call_depth_;
+    const Flow flow = Exec(func->body);
+    --call_depth_;
+
+    // Running off the end of a function that returns a value leaves
+    // whatever is in the slot.
+    bool ok = flow == kReturn || (flow == kNext && func->return_type == kVoid);
+    if (ok && func->return_type != kVoid) {
+        result = return_value_;
+    } else {
+        result = ExprType();
+    }
+
+    values_.resize(frame_);
+    is_set_.resize(frame_);
+    frame_ = caller_frame;
+    num_params_ = caller_num_params;
+    return ok;
+}
+
+ConstEvaluator::Flow ConstEvaluator::Exec(const StmtNode *stmt) {
+    if (!Enter())
+        return kFail;
+
+    ExprType value;
+    Flow flow = kNext;
+    switch (stmt->kind) {
+    case kExprStmtNode:
+        if (!Eval(static_cast<const ExprStmtNode *>(stmt)->expr, value))
+            flow = kFail;
+        break;
+    case kDeclStmtNode: {
+        auto node = static_cast<const DeclStmtNode *>(stmt);
+        if (node->initializer && !(Eval(node->initializer, value) && Store(node, value)))
+            flow = kFail;
+        break;
+    }
+    case kIfStmtNode: {
+        auto node = static_cast<const IfStmtNode *>(stmt);
+        const BlockStmtNode *body = node->else_part;
+        if (!Eval(node->if_part.condition, value)) {
+            flow = kFail;
+            break;
+        }
+        if (value.int_value != 0) {
+            body = node->if_part.body;
+        } else {
+            for (const auto &cond_body : node->elif_part) {
+                if (!Eval(cond_body.condition, value)) {
+                    flow = kFail;
+                    break;
+                }
+                if (value.int_value != 0) {
+                    body = cond_body.body;
+                    break;
+                }
+            }
+        }
+        if (flow == kNext && body)
+            flow = Exec(body);
+        break;
+    }
+    case kWhileStmtNode: {
+        auto node = static_cast<const WhileStmtNode *>(stmt);
+        while (flow == kNext) {
+            if (!Eval(node->condition, value)) {
+                flow = kFail;
+            } else if (value.int_value == 0) {
+                break;
+            } else {
+                flow = Exec(node->body);
+            }
+        }
+        break;
+    }
+    case kReturnStmtNode: {
+        auto node = static_cast<const ReturnStmtNode *>(stmt);
+        return_value_ = ExprType();
+        flow = !node->expr || Eval(node->expr, return_value_) ? kReturn : kFail;
+        break;
+    }
+    case kBlockStmtNode:
+        for (const auto &child : static_cast<const BlockStmtNode *>(stmt)->statements) {
+            flow = Exec(child);
+            if (flow != kNext)
+                break;
+        }
+        break;
+    default:
+        flow = kFail;
+        break;
+    }
+
+    Leave();
+    return flow;
+}
+
+bool ConstEvaluator::Eval(const ExprNode *expr, ExprType &value) {
+    if (expr->type.is_const) {
+        value = expr->type;
+        return true;
+    }
+    if (!Enter())
+        return false;
+
+    ExprType left;
+    ExprType right;
+    bool ok = false;
+    switch (expr->kind) {
+    case kOperatorExprNode: {
+        auto node = static_cast<const OperatorExprNode *>(expr);
+        ok = Eval(node->left, left) && Eval(node->right, right) &&
+             EvalOperator(node, left, right, value);
+        break;
+    }
+    case kNegateExpr: {
+        auto node = static_cast<const NegateExpr *>(expr);
+        ok = Eval(node->operand, left) && EvalNegate(node, left, value);
+        break;
+    }
+    case kAssignExprNode: {
+        auto node = static_cast<const AssignExprNode *>(expr);
+        ok = Eval(node->rhs, right) && Store(node->decl, right);
+        value = ExprType();
+        break;
+    }
+    case kCallExprNode: {
+        auto node = static_cast<const CallExprNode *>(expr);
+        const FuncDefNode *func = Definition(node->func);
+        std::vector<ExprType> args(node->args.size());
+        ok = func != nullptr;
+        for (size_t i = 0; ok && i < args.size(); ++i) {
+            ok = Eval(node->args[i], args[i]);
+        }
+        ok = ok && Call(func, args, value);
+        break;
+    }
+    case kIdentExprNode:
+        ok = Load(static_cast<const IdentExprNode *>(expr)->decl, value);
+        break;
+    default:
+        break;
+    }
+
+    Leave();
+    return ok;
+}
+
+// Only the globals that are known at compile time can be read.
+bool ConstEvaluator::Load(const DeclStmtNode *var, ExprType &value) {
+    if (var->scope == kGlobal) {
+        if (!var->is_const || !var->initializer || !var->initializer->type.is_const)
+            return false;
+        value = var->initializer->type;
+        return true;
+    }
+
+    const size_t index = frame_ + (var->scope == kParam ? var->slot : num_params_ + var->slot);
+    if (!is_set_[index])
+        return false;
+    value = values_[index];
+    return true;
+}
+
+bool ConstEvaluator::Store(const DeclStmtNode *var, const ExprType &value) {
+    if (var->scope == kGlobal)
+        return false;
+
+    const size_t index = frame_ + (var->scope == kParam ? var->slot : num_params_ + var->slot);
+    values_[index] = value;
+    is_set_[index] = true;
+    return true;
+}
+
+bool ConstEvaluator::Enter() {
+    if (steps_ == kMaxSteps || nesting_ == kMaxNesting)
+        return false;
+    ++steps_;
+    ++nesting_;
+    return true;
+}
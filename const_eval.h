@@ -0,0 +1,76 @@
+#ifndef CONST_EVAL_H_
+#define CONST_EVAL_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.h"
+
+// Work out an operator or a negation on constant operands exactly as the
+// code that the Compiler generates for it computes it in the VM. The result
+// has the type of the node. Returns false for what is left to run time,
+// like a division by zero that the VM traps on.
+bool EvalOperator(const OperatorExprNode *node, const ExprType &left, const ExprType &right,
+                  ExprType &result);
+bool EvalNegate(const NegateExpr *node, const ExprType &operand, ExprType &result);
+
+// Interprets calls of user functions with constant arguments at compile
+// time. A call is only worked out when all that it does on the way is
+// pure: no builtins, which do the I/O, no writes to global variables and no
+// reads of those that may change at run time. It also has to stay within
+// the budgets of steps and call depth, and not to read a local variable
+// before setting it, which the VM leaves undefined. Otherwise the call is
+// left to run time.
+//
+// The functions must be checked by the TypeChecker and must stay as they
+// are while they are interpreted.
+class ConstEvaluator {
+public:
+    static constexpr uint32_t kMaxSteps = 100000;   // Per call worked out.
+    static constexpr uint64_t kMaxTotalSteps = 10000000;   // Over all calls.
+    static constexpr uint32_t kMaxCallDepth = 64;
+    static constexpr uint32_t kMaxNesting = 4096;   // Of statements and expressions.
+
+    // The value of a call whose arguments are all constant, in `result`.
+    bool EvalCall(const CallExprNode *call, ExprType &result);
+
+    // The functions of the program. The fused front end resolves calls to
+    // the signatures that the parser scans ahead, which have no body, so
+    // the definitions are looked up here by name.
+    void SetFunctions(Span<FuncDefNode *> functions);
+
+private:
+    enum Flow {
+        kNext,
+        kReturn,
+        kFail,
+    };
+
+    const FuncDefNode *Definition(const FuncDefNode *func) const;
+    bool Call(const FuncDefNode *func, const std::vector<ExprType> &args, ExprType &result);
+    Flow Exec(const StmtNode *stmt);
+    bool Eval(const ExprNode *expr, ExprType &value);
+    bool Load(const DeclStmtNode *var, ExprType &value);
+    bool Store(const DeclStmtNode *var, const ExprType &value);
+    // Counts a step and a level of nesting, undone by Leave().
+    bool Enter();
+    void Leave() { --nesting_; }
+
+private:
+    std::unordered_map<Symbol, const FuncDefNode *> functions_;
+
+    // The parameters then the locals of the functions being called.
+    std::vector<ExprType> values_;
+    std::vector<uint8_t> is_set_;
+    size_t frame_ = 0;          // Where those of the innermost call start.
+    size_t num_params_ = 0;     // Of the innermost call.
+    ExprType return_value_;
+
+    uint32_t steps_ = 0;
+    uint64_t total_steps_ = 0;  // Over all calls, also those left to run time.
+    uint32_t call_depth_ = 0;
+    uint32_t nesting_ = 0;
+};
+
+#endif // CONST_EVAL_H_
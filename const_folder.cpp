@@ -0,0 +1,151 @@
+#include "const_folder.h"
+
+namespace {
+
+// The child of an expression after `n` others, or nullptr after the last.
+ExprNode *Child(ExprNode *expr, uint32_t n) {
+    switch (expr->kind) {
+    case kOperatorExprNode: {
+        auto node = static_cast<OperatorExprNode *>(expr);
+        return n == 0 ? node->left : n == 1 ? node->right : nullptr;
+    }
+    case kNegateExpr:
+        return n == 0 ? static_cast<NegateExpr *>(expr)->operand : nullptr;
+    case kAssignExprNode:
+        return n == 0 ? static_cast<AssignExprNode *>(expr)->rhs : nullptr;
+    case kCallExprNode: {
+        auto node = static_cast<CallExprNode *>(expr);
+        return n < node->args.size() ? node->args[n] : nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+} // namespace
+
+void ConstFolder::Fold(ProgramNode *program) {
+    evaluator_.SetFunctions(program->functions);
+    evaluate_calls_ = true;
+    Walk(program);
+    evaluate_calls_ = false;
+}
+
+void ConstFolder::FoldGlobal(DeclStmtNode *var) {
+    Walk(var);
+}
+
+void ConstFolder::FoldFunction(FuncDefNode *func) {
+    Walk(func);
+}
+
+void ConstFolder::Visit(ProgramNode *node) {
+    for (const auto &var : node->global_vars) {
+        Walk(var);
+    }
+    for (const auto &func : node->functions) {
+        Walk(func);
+    }
+}
+
+void ConstFolder::Visit(ExprStmtNode *node) {
+    Walk(node->expr);
+}
+
+void ConstFolder::Visit(DeclStmtNode *node) {
+    if (node->initializer)
+        Walk(node->initializer);
+}
+
+void ConstFolder::Visit(IfStmtNode *node) {
+    Walk(node->if_part.condition);
+    Walk(node->if_part.body);
+
+    for (const auto &cond_body : node->elif_part) {
+        Walk(cond_body.condition);
+        Walk(cond_body.body);
+    }
+
+    if (node->else_part)
+        Walk(node->else_part);
+}
+
+void ConstFolder::Visit(WhileStmtNode *node) {
+    Walk(node->condition);
+    Walk(node->body);
+}
+
+void ConstFolder::Visit(ReturnStmtNode *node) {
+    if (node->expr)
+        Walk(node->expr);
+}
+
+void ConstFolder::Visit(BlockStmtNode *node) {
+    for (const auto &stmt : node->statements) {
+        Walk(stmt);
+    }
+}
+
+void ConstFolder::Visit(FuncDefNode *node) {
+    Walk(node->body);
+}
+
+void ConstFolder::FoldExpr(ExprNode *root) {
+    const size_t base = expr_stack_.size();
+    expr_stack_.push_back({root, 0});
+
+    while (expr_stack_.size() > base) {
+        ExprFrame &frame = expr_stack_.back();
+        ExprNode *child = Child(frame.node, frame.next_child);
+        if (child != nullptr) {
+            ++frame.next_child;
+            expr_stack_.push_back({child, 0});
+            continue;
+        }
+
+        ExprNode *node = frame.node;
+        expr_stack_.pop_back();
+        switch (node->kind) {
+        case kOperatorExprNode:
+            FoldNode(static_cast<OperatorExprNode *>(node));
+            break;
+        case kNegateExpr:
+            FoldNode(static_cast<NegateExpr *>(node));
+            break;
+        case kCallExprNode:
+            FoldNode(static_cast<CallExprNode *>(node));
+            break;
+        case kIdentExprNode:
+            FoldNode(static_cast<IdentExprNode *>(node));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void ConstFolder::FoldNode(OperatorExprNode *node) {
+    const ExprType &left = node->left->type;
+    const ExprType &right = node->right->type;
+    ExprType value;
+    if (left.is_const && right.is_const && EvalOperator(node, left, right, value))
+        node->type = value;
+}
+
+void ConstFolder::FoldNode(NegateExpr *node) {
+    ExprType value;
+    if (node->operand->type.is_const && EvalNegate(node, node->operand->type, value))
+        node->type = value;
+}
+
+void ConstFolder::FoldNode(CallExprNode *node) {
+    ExprType value;
+    if (evaluate_calls_ && evaluator_.EvalCall(node, value))
+        node->type = value;
+}
+
+void ConstFolder::FoldNode(IdentExprNode *node) {
+    const DeclStmtNode *var = node->decl;
+    if (var->is_const && var->initializer && var->initializer->type.is_const)
+        node->type = var->initializer->type;
+}
@@ -0,0 +1,71 @@
+#ifndef CONST_FOLDER_H_
+#define CONST_FOLDER_H_
+
+#include <vector>
+
+#include "ast.h"
+#include "const_eval.h"
+
+// Works out the expressions whose operands are all known at compile time,
+// exactly as the code that the Compiler would generate for them computes
+// them in the VM, and marks them with ExprType::is_const and their value.
+// A use of a const variable with a constant initializer becomes a constant
+// as well. The Compiler pushes the value of a constant instead of the code
+// computing it. What the VM traps on, like a division by zero, is left to
+// run time.
+//
+// Runs after the TypeChecker, on the global variables in order first, then
+// on the functions in any order, also at the same time with one folder per
+// thread.
+class ConstFolder : private AstWalker<ConstFolder> {
+public:
+    // Also works out the calls of pure functions with constant arguments,
+    // with a ConstEvaluator, since all functions are checked by then.
+    void Fold(ProgramNode *program);
+
+    // For the pipeline and streaming front ends, which fold and generate
+    // each part of the program as soon as it is checked, before the
+    // functions it calls may be. These leave all calls to run time, so with
+    // -O those front ends write other code than the others do, which
+    // computes the same.
+    void FoldGlobal(DeclStmtNode *var);
+    void FoldFunction(FuncDefNode *func);
+
+private:
+    friend class AstWalker<ConstFolder>;
+
+    void Visit(ProgramNode *node);
+    void Visit(ExprStmtNode *node);
+    void Visit(DeclStmtNode *node);
+    void Visit(IfStmtNode *node);
+    void Visit(WhileStmtNode *node);
+    void Visit(ReturnStmtNode *node);
+    void Visit(BlockStmtNode *node);
+    void Visit(OperatorExprNode *node) { FoldExpr(node); }
+    void Visit(NegateExpr *node) { FoldExpr(node); }
+    void Visit(AssignExprNode *node) { FoldExpr(node); }
+    void Visit(CallExprNode *node) { FoldExpr(node); }
+    void Visit(LiteralExprNode *) {}
+    void Visit(IdentExprNode *node) { FoldExpr(node); }
+    void Visit(FuncDefNode *node);
+
+private:
+    // An expression being folded by FoldExpr(), children first.
+    struct ExprFrame {
+        ExprNode *node;
+        uint32_t next_child;
+    };
+
+    void FoldExpr(ExprNode *root);
+    void FoldNode(OperatorExprNode *node);
+    void FoldNode(NegateExpr *node);
+    void FoldNode(CallExprNode *node);
+    void FoldNode(IdentExprNode *node);
+
+private:
+    std::vector<ExprFrame> expr_stack_;
+    ConstEvaluator evaluator_;
+    bool evaluate_calls_ = false;  // Within Fold().
+};
+
+#endif // CONST_FOLDER_H_
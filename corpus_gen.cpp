@@ -0,0 +1,275 @@
+#include "corpus_gen.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+static constexpr uint64_t kBytesPerFunction = 2048;
+
+static constexpr const char *kWords[] = {
+    "count", "index", "total", "value", "offset", "limit",
+    "delta", "result", "acc", "width", "height", "step",
+};
+
+static constexpr const char *kArithOps[] = {" + ", " - ", " * ", " / "};
+static constexpr const char *kCompareOps[] = {" < ", " > ", " <= ", " >= ", " == ", " != "};
+
+namespace {
+
+// Every function has the signature fn f_<i>(int, double) -> int, so that any
+// earlier function can be called from any expression. Declarations only
+// appear at the top level of a function body.
+class CorpusGenerator {
+public:
+    CorpusGenerator(const CorpusOptions &options, std::ostream &out)
+        : options_(options), out_(out), rng_(options.seed) {}
+
+    CorpusStats Run();
+
+private:
+    void Function(uint32_t index, uint64_t budget);
+    void Statement();
+    void IntExpr(int depth);
+    void DoubleExpr(int depth);
+    void Condition();
+    void Call(int depth);
+    void NewName(const char *prefix);
+
+    // Raw engine output keeps the corpus identical across standard libraries,
+    // the distributions are implementation defined.
+    uint32_t Below(uint32_t n) { return rng_() % n; }
+    double Chance() { return rng_() / 4294967296.0; }
+    template <typename T, size_t N>
+    const T &Pick(const T (&items)[N]) { return items[Below(N)]; }
+    const std::string &Pick(const std::vector<std::string> &items) { return items[Below(items.size())]; }
+
+    void Flush();
+
+private:
+    const CorpusOptions &options_;
+    std::ostream &out_;
+    std::mt19937 rng_;
+    CorpusStats stats_;
+    std::string buf_;
+
+    uint32_t function_ = 0;
+    std::vector<std::string> int_vars_;         // Assignable.
+    std::vector<std::string> int_consts_;
+    std::vector<std::string> double_vars_;
+    std::vector<std::string> double_consts_;
+    std::string name_;
+};
+
+CorpusStats CorpusGenerator::Run() {
+    uint32_t num_functions = options_.num_functions;
+    if (num_functions == 0)
+        num_functions = std::max<uint64_t>(1, options_.size / kBytesPerFunction);
+
+    buf_ += "let g_count: int = 0;\n"
+            "const g_scale: double = 1.5;\n\n";
+    Flush();
+
+    const uint64_t budget = options_.size / num_functions;
+    for (uint32_t i = 0; i < num_functions; ++i) {
+        Function(i, budget);
+        Flush();
+    }
+
+    buf_ += "fn main() -> void {\n"
+            "    g_count = f_" + std::to_string(num_functions - 1) + "(1, g_scale);\n"
+            "}\n";
+    Flush();
+
+    stats_.num_functions = num_functions + 1;
+    return stats_;
+}
+
+void CorpusGenerator::Function(uint32_t index, uint64_t budget) {
+    function_ = index;
+    int_vars_ = {"g_count", "n"};
+    int_consts_.clear();
+    double_vars_ = {"x"};
+    double_consts_ = {"g_scale"};
+
+    const size_t start = buf_.size();
+    buf_ += "fn f_" + std::to_string(index) + "(n: int, x: double) -> int {\n";
+
+    // At least a few statements, so that tiny sizes still exercise everything.
+    for (int i = 0; i < 3 || buf_.size() - start < budget; ++i) {
+        buf_ += "    ";
+        Statement();
+        buf_ += '\n';
+    }
+
+    buf_ += "    return ";
+    IntExpr(options_.expr_depth);
+    buf_ += ";\n}\n\n";
+}
+
+void CorpusGenerator::Statement() {
+    const uint32_t kind = Below(100);
+    if (kind < 20) {
+        const bool is_const = Below(4) == 0;
+        NewName("");
+        buf_ += is_const ? "const " : "let ";
+        buf_ += name_ + ": int = ";
+        IntExpr(options_.expr_depth);
+        buf_ += ';';
+        (is_const ? int_consts_ : int_vars_).push_back(name_);
+    } else if (kind < 30) {
+        const bool is_const = Below(4) == 0;
+        NewName("r");
+        buf_ += is_const ? "const " : "let ";
+        buf_ += name_ + ": double = ";
+        DoubleExpr(options_.expr_depth);
+        buf_ += ';';
+        (is_const ? double_consts_ : double_vars_).push_back(name_);
+    } else if (kind < 55) {
+        buf_ += Pick(int_vars_) + " = ";
+        IntExpr(options_.expr_depth);
+        buf_ += ';';
+    } else if (kind < 65) {
+        buf_ += Pick(double_vars_) + " = ";
+        DoubleExpr(options_.expr_depth);
+        buf_ += ';';
+    } else if (kind < 80) {
+        buf_ += "if ";
+        Condition();
+        buf_ += " {\n        " + Pick(int_vars_) + " = ";
+        IntExpr(options_.expr_depth);
+        buf_ += ";\n    }";
+        if (Below(2) == 0) {
+            buf_ += " else if ";
+            Condition();
+            buf_ += " {\n        " + Pick(double_vars_) + " = ";
+            DoubleExpr(options_.expr_depth);
+            buf_ += ";\n    }";
+        }
+        if (Below(2) == 0) {
+            buf_ += " else {\n        " + Pick(int_vars_) + " = ";
+            IntExpr(options_.expr_depth);
+            buf_ += ";\n    }";
+        }
+    } else if (kind < 90) {
+        const std::string &var = Pick(int_vars_);
+        buf_ += "while " + var + " > " + std::to_string(Below(10000)) + " {\n        ";
+        buf_ += var + " = " + var + " - ";
+        IntExpr(options_.expr_depth);
+        buf_ += ";\n    }";
+    } else if (kind < 95 && function_ > 0) {
+        Call(options_.expr_depth);
+        buf_ += ';';
+    } else {
+        buf_ += "// ";
+        buf_ += Pick(kWords);
+        buf_ += " is updated below";
+    }
+}
+
+void CorpusGenerator::IntExpr(int depth) {
+    if (depth > 0 && Below(3) != 0) {
+        switch (Below(4)) {
+        case 0:
+            buf_ += '(';
+            IntExpr(depth - 1);
+            buf_ += ')';
+            return;
+        case 1:
+            buf_ += "-(";
+            IntExpr(depth - 1);
+            buf_ += ')';
+            return;
+        default:
+            IntExpr(depth - 1);
+            buf_ += Pick(kArithOps);
+            IntExpr(depth - 1);
+            return;
+        }
+    }
+
+    const double leaf = Chance();
+    if (leaf < options_.ident_density) {
+        const size_t n = int_vars_.size() + int_consts_.size();
+        const size_t i = Below(n);
+        buf_ += i < int_vars_.size() ? int_vars_[i] : int_consts_[i - int_vars_.size()];
+    } else if (leaf < options_.ident_density + options_.literal_density ||
+               function_ == 0 || depth == 0) {
+        buf_ += std::to_string(Below(1000000));
+    } else {
+        Call(depth - 1);
+    }
+}
+
+void CorpusGenerator::DoubleExpr(int depth) {
+    if (depth > 0 && Below(3) != 0) {
+        switch (Below(4)) {
+        case 0:
+            buf_ += '(';
+            DoubleExpr(depth - 1);
+            buf_ += ')';
+            return;
+        case 1:
+            buf_ += "-(";
+            DoubleExpr(depth - 1);
+            buf_ += ')';
+            return;
+        default:
+            DoubleExpr(depth - 1);
+            buf_ += Pick(kArithOps);
+            DoubleExpr(depth - 1);
+            return;
+        }
+    }
+
+    if (Chance() < options_.ident_density) {
+        const size_t n = double_vars_.size() + double_consts_.size();
+        const size_t i = Below(n);
+        buf_ += i < double_vars_.size() ? double_vars_[i] : double_consts_[i - double_vars_.size()];
+        return;
+    }
+
+    buf_ += std::to_string(Below(10000)) + "." + std::to_string(Below(100));
+    if (Below(4) == 0)
+        buf_ += "e" + std::to_string(Below(20));
+}
+
+void CorpusGenerator::Condition() {
+    // A negation takes everything to its right as operand, comparison
+    // included, so the left side needs parentheses.
+    buf_ += '(';
+    IntExpr(options_.expr_depth / 2);
+    buf_ += ')';
+    buf_ += Pick(kCompareOps);
+    IntExpr(options_.expr_depth / 2);
+}
+
+// A call of an earlier function, only valid when function_ > 0.
+void CorpusGenerator::Call(int depth) {
+    buf_ += "f_" + std::to_string(Below(function_)) + "(";
+    IntExpr(depth);
+    buf_ += ", ";
+    DoubleExpr(depth);
+    buf_ += ')';
+}
+
+void CorpusGenerator::NewName(const char *prefix) {
+    name_ = prefix;
+    name_ += Pick(kWords);
+    name_ += '_';
+    name_ += std::to_string(int_vars_.size() + int_consts_.size() +
+                            double_vars_.size() + double_consts_.size());
+}
+
+void CorpusGenerator::Flush() {
+    stats_.bytes += buf_.size();
+    stats_.lines += std::count(buf_.begin(), buf_.end(), '\n');
+    out_ << buf_;
+    buf_.clear();
+}
+
+} // namespace
+
+CorpusStats GenerateCorpus(const CorpusOptions &options, std::ostream &out) {
+    return CorpusGenerator(options, out).Run();
+}
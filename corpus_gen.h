@@ -0,0 +1,30 @@
+#ifndef CORPUS_GEN_H_
+#define CORPUS_GEN_H_
+
+#include <cstdint>
+#include <ostream>
+
+// Shape of a synthetic C0 program. The densities pick what the leaves of
+// generated expressions are: variables with probability ident_density,
+// literals with probability literal_density and calls of earlier functions
+// otherwise.
+struct CorpusOptions {
+    uint64_t size = 1 << 20;        // Approximate size in bytes.
+    double ident_density = 0.5;
+    double literal_density = 0.4;
+    int expr_depth = 3;             // Maximum nesting of operators in an expression.
+    uint32_t num_functions = 0;     // 0 picks one function per 2 KB.
+    uint32_t seed = 1;
+};
+
+struct CorpusStats {
+    uint64_t bytes = 0;
+    uint64_t lines = 0;
+    uint32_t num_functions = 0;
+};
+
+// Write a program that parses and type checks. The output depends only on
+// the options, so runs on different machines and commits see the same input.
+CorpusStats GenerateCorpus(const CorpusOptions &options, std::ostream &out);
+
+#endif // CORPUS_GEN_H_
@@ -0,0 +1,286 @@
+#include "flat_ast.h"
+
+namespace {
+
+class Flattener : public AstVisitor {
+public:
+    explicit Flattener(FlatAst &ast) : ast_(ast) {}
+
+    void Visit(ProgramNode *node) override;
+    void Visit(ExprStmtNode *node) override;
+    void Visit(DeclStmtNode *node) override;
+    void Visit(IfStmtNode *node) override;
+    void Visit(WhileStmtNode *node) override;
+    void Visit(ReturnStmtNode *node) override;
+    void Visit(BlockStmtNode *node) override;
+    void Visit(OperatorExprNode *node) override;
+    void Visit(NegateExpr *node) override;
+    void Visit(AssignExprNode *node) override;
+    void Visit(CallExprNode *node) override;
+    void Visit(LiteralExprNode *node) override;
+    void Visit(IdentExprNode *node) override;
+    void Visit(FuncDefNode *node) override;
+
+private:
+    // An expression being flattened by AddExpr().
+    struct ExprFrame {
+        ExprNode *node;
+        uint32_t next_child;        // Number of steps done.
+        uint32_t first;             // First record of its subtree.
+    };
+
+    // Flatten an expression, returns the index of its root. Like the tree
+    // passes, this keeps its own stack instead of recursing, and goes in
+    // steps that each return the next child or nullptr once the node is done.
+    uint32_t AddExpr(ExprNode *root);
+    ExprNode *AddStep(ExprFrame &frame);
+    void PushExpr(FlatExprKind kind, ExprNode *node, uint32_t value, uint32_t first);
+    uint32_t PushStmt(FlatStmtKind kind, Position pos, uint32_t a, uint32_t b);
+    FlatStmt MakeDecl(DeclStmtNode *node);
+
+private:
+    FlatAst &ast_;
+    std::vector<ExprFrame> expr_stack_;
+};
+
+uint32_t Flattener::AddExpr(ExprNode *root) {
+    if (root == nullptr)
+        return kFlatNone;
+
+    expr_stack_.push_back({root, 0, uint32_t(ast_.exprs.size())});
+    while (!expr_stack_.empty()) {
+        ExprFrame &frame = expr_stack_.back();
+        ExprNode *child = AddStep(frame);
+
+        if (child == nullptr) {
+            expr_stack_.pop_back();
+        } else {
+            ++frame.next_child;
+            expr_stack_.push_back({child, 0, uint32_t(ast_.exprs.size())});
+        }
+    }
+    return ast_.exprs.size() - 1;
+}
+
+ExprNode *Flattener::AddStep(ExprFrame &frame) {
+    const uint32_t step = frame.next_child;
+
+    switch (frame.node->kind) {
+    case kOperatorExprNode: {
+        auto node = static_cast<OperatorExprNode *>(frame.node);
+        if (step == 0)
+            return node->left;
+        if (step == 1)
+            return node->right;
+
+        PushExpr(kFlatOperator, node, 0, frame.first);
+        ast_.exprs.back().op = node->op;
+        break;
+    }
+    case kNegateExpr: {
+        auto node = static_cast<NegateExpr *>(frame.node);
+        if (step == 0)
+            return node->operand;
+
+        PushExpr(kFlatNegate, node, 0, frame.first);
+        break;
+    }
+    case kAssignExprNode: {
+        auto node = static_cast<AssignExprNode *>(frame.node);
+        if (step == 0)
+            return node->rhs;
+
+        PushExpr(kFlatAssign, node, node->lhs, frame.first);
+        break;
+    }
+    case kCallExprNode: {
+        auto node = static_cast<CallExprNode *>(frame.node);
+        if (step < node->args.size())
+            return node->args[step];
+
+        PushExpr(kFlatCall, node, node->func_name, frame.first);
+        break;
+    }
+    case kLiteralExprNode: {
+        auto node = static_cast<LiteralExprNode *>(frame.node);
+        FlatExprKind kind = node->type.type == kInt ? kFlatIntLiteral : kFlatDoubleLiteral;
+        PushExpr(kind, node, ast_.literals.size(), frame.first);
+        ast_.literals.push_back(static_cast<uint64_t>(node->type.int_value));
+        break;
+    }
+    case kIdentExprNode: {
+        auto node = static_cast<IdentExprNode *>(frame.node);
+        PushExpr(kFlatIdent, node, node->var_name, frame.first);
+        break;
+    }
+    default:
+        break;
+    }
+    return nullptr;
+}
+
+void Flattener::PushExpr(FlatExprKind kind, ExprNode *node, uint32_t value, uint32_t first) {
+    FlatExpr expr;
+    expr.kind = kind;
+    expr.op = 0;
+    expr.type = node->type.type;
+    expr.pos = node->pos;
+    expr.value = value;
+    expr.first = first;
+    ast_.exprs.push_back(expr);
+}
+
+uint32_t Flattener::PushStmt(FlatStmtKind kind, Position pos, uint32_t a, uint32_t b) {
+    FlatStmt stmt;
+    stmt.kind = kind;
+    stmt.type = kVoid;
+    stmt.is_const = false;
+    stmt.is_func_body = false;
+    stmt.pos = pos;
+    stmt.a = a;
+    stmt.b = b;
+    ast_.stmts.push_back(stmt);
+    return ast_.stmts.size() - 1;
+}
+
+FlatStmt Flattener::MakeDecl(DeclStmtNode *node) {
+    FlatStmt stmt;
+    stmt.kind = kFlatDecl;
+    stmt.type = node->type;
+    stmt.is_const = node->is_const;
+    stmt.is_func_body = false;
+    stmt.pos = node->pos;
+    stmt.a = node->name;
+    stmt.b = AddExpr(node->initializer);
+    return stmt;
+}
+
+void Flattener::Visit(ProgramNode *node) {
+    ast_.source = node->source;
+
+    for (const auto &var : node->global_vars) {
+        ast_.globals.push_back(MakeDecl(var));
+    }
+
+    for (const auto &func : node->functions) {
+        func->Accept(*this);
+    }
+}
+
+void Flattener::Visit(FuncDefNode *node) {
+    FlatFunc func;
+    func.name = node->name;
+    func.return_type = node->return_type;
+    func.pos = node->pos;
+    func.first_param = ast_.params.size();
+    func.num_params = node->params.size();
+    func.num_locals = 0;
+
+    for (const auto &param : node->params) {
+        ast_.params.push_back(MakeDecl(param));
+    }
+
+    func.body = ast_.stmts.size();
+    node->body->Accept(*this);
+    ast_.functions.push_back(func);
+}
+
+void Flattener::Visit(ExprStmtNode *node) {
+    uint32_t expr = AddExpr(node->expr);
+    PushStmt(kFlatExprStmt, node->pos, expr, kFlatNone);
+}
+
+void Flattener::Visit(DeclStmtNode *node) {
+    ast_.stmts.push_back(MakeDecl(node));
+}
+
+void Flattener::Visit(IfStmtNode *node) {
+    uint32_t cond = AddExpr(node->if_part.condition);
+    uint32_t stmt = PushStmt(kFlatIf, node->pos, cond, kFlatNone);
+    node->if_part.body->Accept(*this);
+
+    for (const auto &cond_body : node->elif_part) {
+        cond = AddExpr(cond_body.condition);
+        uint32_t elif = PushStmt(kFlatElseIf, cond_body.condition->pos, cond, kFlatNone);
+        cond_body.body->Accept(*this);
+        ast_.stmts[elif].b = ast_.stmts.size();
+    }
+
+    if (node->else_part)
+        node->else_part->Accept(*this);
+
+    ast_.stmts[stmt].b = ast_.stmts.size();
+}
+
+void Flattener::Visit(WhileStmtNode *node) {
+    uint32_t cond = AddExpr(node->condition);
+    uint32_t stmt = PushStmt(kFlatWhile, node->pos, cond, kFlatNone);
+    node->body->Accept(*this);
+    ast_.stmts[stmt].b = ast_.stmts.size();
+}
+
+void Flattener::Visit(ReturnStmtNode *node) {
+    uint32_t expr = AddExpr(node->expr);
+    PushStmt(kFlatReturn, node->pos, expr, kFlatNone);
+}
+
+void Flattener::Visit(BlockStmtNode *node) {
+    uint32_t stmt = PushStmt(kFlatBlock, node->pos, kFlatNone, kFlatNone);
+    ast_.stmts[stmt].is_func_body = node->is_func_body;
+
+    for (const auto &child : node->statements) {
+        child->Accept(*this);
+    }
+    ast_.stmts[stmt].b = ast_.stmts.size();
+}
+
+void Flattener::Visit(OperatorExprNode *node) {
+    AddExpr(node);
+}
+
+void Flattener::Visit(NegateExpr *node) {
+    AddExpr(node);
+}
+
+void Flattener::Visit(AssignExprNode *node) {
+    AddExpr(node);
+}
+
+void Flattener::Visit(CallExprNode *node) {
+    AddExpr(node);
+}
+
+void Flattener::Visit(LiteralExprNode *node) {
+    AddExpr(node);
+}
+
+void Flattener::Visit(IdentExprNode *node) {
+    AddExpr(node);
+}
+
+} // namespace
+
+size_t FlatAst::MemoryUsage() const {
+    return exprs.capacity() * sizeof(FlatExpr) +
+           literals.capacity() * sizeof(uint64_t) +
+           stmts.capacity() * sizeof(FlatStmt) +
+           globals.capacity() * sizeof(FlatStmt) +
+           params.capacity() * sizeof(FlatStmt) +
+           functions.capacity() * sizeof(FlatFunc);
+}
+
+FlatAst Flatten(ProgramNode &program) {
+    FlatAst ast;
+    Flattener flattener(ast);
+    program.Accept(flattener);
+
+    // The arrays are complete, so give back what growing them left unused,
+    // which can be almost half of them.
+    ast.exprs.shrink_to_fit();
+    ast.literals.shrink_to_fit();
+    ast.stmts.shrink_to_fit();
+    ast.globals.shrink_to_fit();
+    ast.params.shrink_to_fit();
+    ast.functions.shrink_to_fit();
+    return ast;
+}
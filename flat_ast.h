@@ -0,0 +1,117 @@
+#ifndef FLAT_AST_H_
+#define FLAT_AST_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ast.h"
+
+// A compact form of the syntax tree: every node is a 16-byte record in one
+// of a few arrays, and nodes refer to each other by 32-bit index.
+//
+// Expressions are stored in post-order, so the operand of a unary node is
+// the record right before it, and every record knows where its subtree
+// starts. The left operand of a binary node ends right before its right
+// operand starts, and the arguments of a call are found the same way going
+// backwards from the call.
+//
+// Statements are stored in pre-order. Records with children keep the index
+// one past their subtree in `b`, so a block iterates its statements by
+// jumping from one FlatAst::End() to the next. An if statement is followed by its body, then an
+// kFlatElseIf record with a body for each else-if part, then the else body.
+//
+// Like the tree passes, Flatten() and the passes over a FlatAst walk
+// expressions with a stack of their own instead of recursing, so they take
+// expressions as deep as the parser does.
+
+constexpr uint32_t kFlatNone = 0xffffffffu;
+
+enum FlatExprKind : uint8_t {
+    kFlatIntLiteral,
+    kFlatDoubleLiteral,
+    kFlatIdent,
+    kFlatAssign,
+    kFlatNegate,
+    kFlatOperator,
+    kFlatCall,
+};
+
+struct FlatExpr {
+    FlatExprKind kind;
+    uint8_t op;             // TokenType of a kFlatOperator, see also value.
+    uint8_t type;           // VarType, set by the type checker.
+    Position pos;
+
+    // Symbol, or the index of a literal. The type checker replaces the
+    // Symbol of a kFlatIdent or kFlatAssign by the slot of the variable, and
+    // puts its VarScope in op.
+    uint32_t value;
+    uint32_t first;         // First record of the subtree.
+};
+
+enum FlatStmtKind : uint8_t {
+    kFlatDecl,
+    kFlatExprStmt,
+    kFlatReturn,
+    kFlatBlock,
+    kFlatIf,
+    kFlatElseIf,
+    kFlatWhile,
+};
+
+struct FlatStmt {
+    FlatStmtKind kind;
+    uint8_t type;           // VarType of a kFlatDecl.
+    bool is_const;
+    bool is_func_body;
+    Position pos;
+
+    // kFlatDecl: name in a, which the type checker replaces by the slot of
+    // the variable as in DeclStmtNode, initializer in b. kFlatExprStmt and
+    // kFlatReturn: expression in a. kFlatIf, kFlatElseIf and kFlatWhile:
+    // condition in a, index one past the subtree in b. kFlatBlock: only the
+    // latter, in b.
+    uint32_t a;
+    uint32_t b;
+};
+
+struct FlatFunc {
+    Symbol name;
+    VarType return_type;
+    Position pos;
+    uint32_t first_param;   // Index in FlatAst::params.
+    uint32_t num_params;
+    uint32_t body;          // The kFlatBlock of the body.
+    uint32_t num_locals;    // Set by the type checker.
+};
+
+struct FlatAst {
+    std::vector<FlatExpr> exprs;
+    std::vector<uint64_t> literals;
+    std::vector<FlatStmt> stmts;
+    std::vector<FlatStmt> globals;  // kFlatDecl records.
+    std::vector<FlatStmt> params;   // kFlatDecl records.
+    std::vector<FlatFunc> functions;
+
+    std::shared_ptr<SourceBuffer> source;
+
+    // Index one past the subtree of a statement.
+    uint32_t End(uint32_t stmt) const {
+        const FlatStmt &s = stmts[stmt];
+        return s.kind == kFlatBlock || s.kind == kFlatIf || s.kind == kFlatElseIf ||
+               s.kind == kFlatWhile ? s.b : stmt + 1;
+    }
+
+    // Root of the operand before the subtree rooted at `expr`, that is the
+    // left operand of a binary node when `expr` is its right one.
+    uint32_t Previous(uint32_t expr) const { return exprs[expr].first - 1; }
+
+    size_t MemoryUsage() const;
+};
+
+// Convert a parsed program. The result does not refer to the tree, which
+// can be released afterwards.
+FlatAst Flatten(ProgramNode &program);
+
+#endif // FLAT_AST_H_
@@ -0,0 +1,171 @@
+#include "incremental_scanner.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+void IncrementalScanner::Load(std::string_view text) {
+    lines_.clear();
+    num_tokens_ = 0;
+    num_errors_ = 0;
+
+    // Split on every newline, so that Export() gives back the same text.
+    size_t start = 0;
+    while (true) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos)
+            end = text.size();
+
+        Line &line = *lines_.emplace_back(std::make_unique<Line>());
+        line.text = text.substr(start, end - start);
+        ScanLine(line);
+
+        if (end == text.size())
+            break;
+        start = end + 1;
+    }
+}
+
+bool IncrementalScanner::Update(const std::vector<LineEdit> &edits, std::string &error) {
+    std::vector<const LineEdit *> order;
+    order.reserve(edits.size());
+    for (const LineEdit &edit : edits) {
+        order.push_back(&edit);
+    }
+    std::sort(order.begin(), order.end(), [](const LineEdit *a, const LineEdit *b) {
+        return a->first_line < b->first_line;
+    });
+
+    // Check all edits before applying any.
+    size_t next_free = 1;   // First line that no earlier edit touches.
+    for (size_t i = 0; i < order.size(); ++i) {
+        const LineEdit &edit = *order[i];
+        const size_t end = edit.first_line + size_t(edit.num_lines);
+        if (edit.first_line == 0 || end - 1 > lines_.size()) {
+            std::ostringstream message;
+            message << "Edit of " << edit.num_lines << " lines at line " << edit.first_line
+                    << " is out of range, the text has " << lines_.size() << " lines";
+            error = message.str();
+            return false;
+        }
+        if (i > 0 && (edit.first_line < next_free || edit.first_line == order[i - 1]->first_line)) {
+            std::ostringstream message;
+            message << "Edits at lines " << order[i - 1]->first_line << " and "
+                    << edit.first_line << " overlap";
+            error = message.str();
+            return false;
+        }
+        next_free = std::max(next_free, end);
+    }
+
+    // Apply the edits bottom up, so that the line numbers of the remaining
+    // ones still hold.
+    std::reverse(order.begin(), order.end());
+    for (const LineEdit *edit : order) {
+        const size_t first = edit->first_line - 1;
+        const size_t num_old = edit->num_lines;
+        const size_t num_new = edit->new_lines.size();
+        const size_t num_kept = std::min(num_old, num_new);
+
+        // Lines that are replaced one for one are re-lexed in place.
+        for (size_t i = 0; i < num_kept; ++i) {
+            Line &line = *lines_[first + i];
+            Forget(line);
+            line.text = edit->new_lines[i];
+            ScanLine(line);
+        }
+
+        if (num_old > num_new) {
+            auto begin = lines_.begin() + first + num_kept;
+            auto end = lines_.begin() + first + num_old;
+            for (auto it = begin; it != end; ++it)
+                Forget(**it);
+            lines_.erase(begin, end);
+        } else if (num_new > num_old) {
+            std::vector<std::unique_ptr<Line>> inserted(num_new - num_old);
+            for (size_t i = 0; i < inserted.size(); ++i) {
+                inserted[i] = std::make_unique<Line>();
+                inserted[i]->text = edit->new_lines[num_kept + i];
+                ScanLine(*inserted[i]);
+            }
+            lines_.insert(lines_.begin() + first + num_kept,
+                          std::make_move_iterator(inserted.begin()),
+                          std::make_move_iterator(inserted.end()));
+        }
+    }
+    return true;
+}
+
+bool IncrementalScanner::FirstError(uint32_t &line_no, uint32_t &col_no,
+                                    std::string &message) const {
+    if (num_errors_ == 0)
+        return false;
+
+    for (size_t i = 0; i < lines_.size(); ++i) {
+        const Line &line = *lines_[i];
+        if (line.error_col >= 0) {
+            line_no = i + 1;
+            col_no = line.error_col + 1;
+            message = line.error;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<SourceBuffer> IncrementalScanner::Export(TokenStore &tokens) const {
+    std::string text;
+    for (size_t i = 0; i < lines_.size(); ++i) {
+        if (i > 0)
+            text += '\n';
+        text += lines_[i]->text;
+    }
+    auto source = SourceBuffer::FromString(std::move(text));
+    std::string_view view = source->Text();
+
+    tokens = TokenStore();
+    uint32_t line_offset = 0;
+    for (const auto &line : lines_) {
+        for (const LineToken &lt : line->tokens) {
+            Token tk;
+            tk.type = lt.type;
+            tk.pos.offset = line_offset + lt.col;
+            tk.lexeme = view.substr(tk.pos.offset, lt.length);
+            tk.sym = lt.sym;
+            tk.int_value = lt.int_value;
+            tokens.Push(tk);
+        }
+        line_offset += line->text.size() + 1;
+    }
+    return source;
+}
+
+void IncrementalScanner::ScanLine(Line &line) {
+    scratch_.clear();
+    line.tokens.clear();
+    line.error.clear();
+    line.error_col = -1;
+
+    if (!scanner_.ScanLine(line.text, scratch_, line.error, line.error_col)) {
+        line.error_col = std::max(line.error_col, 0);
+        ++num_errors_;
+    }
+
+    line.tokens.reserve(scratch_.size());
+    for (const Token &tk : scratch_) {
+        LineToken lt;
+        lt.type = tk.type;
+        lt.col = tk.pos.offset;
+        lt.length = tk.lexeme.size();
+        lt.sym = tk.sym;
+        lt.int_value = tk.int_value;
+        line.tokens.push_back(lt);
+    }
+    num_tokens_ += line.tokens.size();
+}
+
+void IncrementalScanner::Forget(const Line &line) {
+    num_tokens_ -= line.tokens.size();
+    if (line.error_col >= 0)
+        --num_errors_;
+}
@@ -0,0 +1,76 @@
+#ifndef INCREMENTAL_SCANNER_H_
+#define INCREMENTAL_SCANNER_H_
+
+#include "scanner.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Replace `num_lines` lines starting at the 1-based `first_line` with
+// `new_lines`. num_lines == 0 inserts before first_line.
+struct LineEdit {
+    uint32_t first_line;
+    uint32_t num_lines;
+    std::vector<std::string> new_lines;
+};
+
+// Keeps the tokens of a file per line, so that an edit only re-lexes the
+// lines it touches. Token positions are stored relative to their line, which
+// makes the tokens of later lines shift for free when line lengths change.
+class IncrementalScanner {
+public:
+    IncrementalScanner() : scanner_(kScanEager) {}
+
+    void Load(std::string_view text);
+
+    // Apply edits whose line numbers refer to the text before the update,
+    // in any order. Returns false with the reason in `error` and leaves the
+    // text as it is if an edit is out of range, or if two of them overlap
+    // or start at the same line, which would make their order ambiguous.
+    bool Update(const std::vector<LineEdit> &edits, std::string &error);
+
+    size_t NumLines() const { return lines_.size(); }
+    size_t NumTokens() const { return num_tokens_; }
+
+    // The first lexical error in line order, as ScanFile() would report it.
+    // Returns false when the text has none.
+    bool FirstError(uint32_t &line_no, uint32_t &col_no, std::string &message) const;
+
+    // Join the lines into a source buffer and the line tokens into one
+    // stream with absolute positions, ready for Parser::ParseTokens().
+    std::shared_ptr<SourceBuffer> Export(TokenStore &tokens) const;
+
+private:
+    struct LineToken {
+        TokenType type;
+        uint32_t col;
+        uint32_t length;
+        Symbol sym;
+        union {
+            int64_t int_value;
+            double double_value;
+        };
+    };
+
+    struct Line {
+        std::string text;
+        std::vector<LineToken> tokens;
+        int error_col = -1;             // -1 when the line has no lexical error.
+        std::string error;
+    };
+
+    void ScanLine(Line &line);
+    void Forget(const Line &line);
+
+private:
+    Scanner scanner_;
+    std::vector<std::unique_ptr<Line>> lines_;     // Boxed, so that inserting lines moves pointers only.
+    std::vector<Token> scratch_;
+    size_t num_tokens_ = 0;
+    size_t num_errors_ = 0;
+};
+
+#endif // INCREMENTAL_SCANNER_H_
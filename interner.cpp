@@ -0,0 +1,73 @@
+#include "interner.h"
+
+#include <algorithm>
+#include <cstring>
+
+static constexpr size_t kInitialSlots = 1024;
+static constexpr size_t kBlockSize = 64 * 1024;
+
+Interner &Interner::Global() {
+    static Interner interner;
+    return interner;
+}
+
+Interner::Interner() : slots_(kInitialSlots, kNoSymbol) {
+}
+
+Symbol Interner::Intern(std::string_view name) {
+    const uint32_t hash = Hash(name);
+    const size_t mask = slots_.size() - 1;
+
+    size_t i = hash & mask;
+    for (; slots_[i] != kNoSymbol; i = (i + 1) & mask) {
+        Symbol sym = slots_[i];
+        if (hashes_[sym] == hash && names_[sym] == name)
+            return sym;
+    }
+
+    Symbol sym = names_.size();
+    names_.push_back(Store(name));
+    hashes_.push_back(hash);
+    slots_[i] = sym;
+
+    // Keep the load factor at most 1/2.
+    if (names_.size() * 2 > slots_.size())
+        Grow();
+    return sym;
+}
+
+// FNV-1a.
+uint32_t Interner::Hash(std::string_view name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+std::string_view Interner::Store(std::string_view name) {
+    if (block_used_ + name.size() > block_size_) {
+        block_size_ = std::max(kBlockSize, name.size());
+        blocks_.push_back(std::make_unique<char[]>(block_size_));
+        block_used_ = 0;
+    }
+
+    char *p = blocks_.back().get() + block_used_;
+    memcpy(p, name.data(), name.size());
+    block_used_ += name.size();
+    return {p, name.size()};
+}
+
+void Interner::Grow() {
+    std::vector<Symbol> slots(slots_.size() * 2, kNoSymbol);
+    const size_t mask = slots.size() - 1;
+
+    for (Symbol sym = 0; sym < names_.size(); ++sym) {
+        size_t i = hashes_[sym] & mask;
+        while (slots[i] != kNoSymbol)
+            i = (i + 1) & mask;
+        slots[i] = sym;
+    }
+    slots_.swap(slots);
+}
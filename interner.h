@@ -0,0 +1,47 @@
+#ifndef INTERNER_H_
+#define INTERNER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Dense id of an interned identifier. Equal names have equal ids.
+using Symbol = uint32_t;
+
+constexpr Symbol kNoSymbol = 0xffffffffu;
+
+// Maps identifiers to symbols and back. The names are copied into storage
+// owned by the interner, so symbols stay valid after the source is released.
+class Interner {
+public:
+    // The interner shared by all compiler phases.
+    static Interner &Global();
+
+    Interner();
+
+    Symbol Intern(std::string_view name);
+    std::string_view Name(Symbol sym) const { return names_[sym]; }
+    size_t Size() const { return names_.size(); }
+
+private:
+    static uint32_t Hash(std::string_view name);
+    std::string_view Store(std::string_view name);
+    void Grow();
+
+private:
+    std::vector<Symbol> slots_;         // Open addressing, linear probing.
+    std::vector<std::string_view> names_;
+    std::vector<uint32_t> hashes_;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t block_used_ = 0;
+    size_t block_size_ = 0;
+};
+
+// Name of a symbol in the global interner.
+inline std::string_view SymbolName(Symbol sym) {
+    return Interner::Global().Name(sym);
+}
+
+#endif // INTERNER_H_
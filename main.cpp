@@ -1,29 +1,252 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "analyzer.h"
 #include "compiler.h"
+#include "const_folder.h"
+#include "pipeline.h"
 
 using namespace std;
 
+// Checks each part of the program and allocates its slots as soon as it is
+// parsed, leaving only code generation for after the parse. With -O the
+// whole program is folded before that, as with the passes one after the
+// other, so that calls are worked out too and the output is the same.
+class FusedFrontEnd : public ParseListener {
+public:
+    FusedFrontEnd(TypeChecker &checker, Compiler &compiler)
+        : checker_(checker), compiler_(compiler) {}
+
+    void OnSignatures(const std::shared_ptr<SourceBuffer> &source,
+                      Span<FuncDefNode *> functions) override {
+        checker_.DeclareFunctions(source, functions);
+    }
+
+    void OnGlobalVar(DeclStmtNode *var) override {
+        checker_.Walk(var);
+        compiler_.AllocateGlobal(var);
+    }
+
+    void OnFuncDef(FuncDefNode *func) override {
+        checker_.Walk(func);
+        compiler_.AllocateFunc(func);
+    }
+
+private:
+    TypeChecker &checker_;
+    Compiler &compiler_;
+};
+
+// Checks, generates and writes each function as soon as it is parsed, after
+// which the parser releases it. Only the global variables and the headers
+// of the functions stay around. Constants are folded with the folder, if
+// any, except for calls, see ConstFolder::FoldFunction().
+class StreamingFrontEnd : public ParseListener {
+public:
+    StreamingFrontEnd(TypeChecker &checker, Compiler &compiler, ConstFolder *folder)
+        : checker_(checker), compiler_(compiler), folder_(folder) {}
+
+    void OnSignatures(const std::shared_ptr<SourceBuffer> &source,
+                      Span<FuncDefNode *> functions) override {
+        checker_.DeclareFunctions(source, functions);
+        signatures_ = functions;
+    }
+
+    void OnGlobalVar(DeclStmtNode *var) override {
+        checker_.Walk(var);
+        if (folder_)
+            folder_->FoldGlobal(var);
+        compiler_.AllocateGlobal(var);
+    }
+
+    void OnFuncDef(FuncDefNode *func) override {
+        if (!started_)
+            Start();
+        checker_.Walk(func);
+        if (folder_)
+            folder_->FoldFunction(func);
+        compiler_.StreamFunc(func);
+    }
+
+    // Write the rest once the whole program is parsed.
+    void Finish(ProgramNode *program) {
+        if (!started_)
+            Start();
+        compiler_.EndStream(program);
+    }
+
+private:
+    // The globals are all allocated by the first function.
+    void Start() {
+        compiler_.BeginStream(signatures_);
+        started_ = true;
+    }
+
+private:
+    TypeChecker &checker_;
+    Compiler &compiler_;
+    ConstFolder *folder_;
+    Span<FuncDefNode *> signatures_;
+    bool started_ = false;
+};
+
+// The temporary file that the streaming front end writes next to the
+// output, removed at exit unless the compile gets through and it replaces
+// the output. A failed compile leaves the output as it was.
+static std::string partial_output;
+
+static void RemovePartialOutput() {
+    if (!partial_output.empty())
+        std::remove(partial_output.c_str());
+}
+
 int main(int argc, char const *argv[]) {
-    if (argc != 3) {
-        cout << "Usage: " << argv[0] << " <input> <output>" << endl;
+    ScanMode scan_mode = kScanStreaming;
+    unsigned num_threads = DefaultThreadCount();
+    bool flat_ast = false;
+    bool fused = false;
+    bool parallel_parse = false;
+    bool parallel_check = false;
+    bool parallel_codegen = false;
+    bool pipelined = false;
+    bool streaming = false;
+    bool optimize = false;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--eager-scan") {
+            scan_mode = kScanEager;
+        } else if (arg == "--parallel-scan") {
+            scan_mode = kScanParallel;
+        } else if (arg == "--flat-ast") {
+            flat_ast = true;
+        } else if (arg == "--fused") {
+            fused = true;
+        } else if (arg == "--parallel-parse") {
+            parallel_parse = true;
+        } else if (arg == "--parallel-check") {
+            parallel_check = true;
+        } else if (arg == "--parallel-codegen") {
+            parallel_codegen = true;
+        } else if (arg == "--pipeline") {
+            pipelined = true;
+        } else if (arg == "--streaming") {
+            streaming = true;
+        } else if (arg == "-O") {
+            optimize = true;
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            num_threads = std::max(1, atoi(arg.c_str() + 10));
+        } else {
+            files.push_back(std::move(arg));
+        }
+    }
+
+    if (files.size() != 2 || (fused && (flat_ast || parallel_parse || parallel_check)) ||
+        (flat_ast && (parallel_check || parallel_codegen || optimize)) ||
+        (pipelined && (flat_ast || fused || parallel_parse || parallel_check || parallel_codegen)) ||
+        (streaming && (flat_ast || fused || pipelined || parallel_parse || parallel_check || parallel_codegen))) {
+        cout << "Usage: " << argv[0]
+             << " [-O] [--eager-scan | --parallel-scan] [--threads=N] [--parallel-parse]"
+             << " [--parallel-check] [--parallel-codegen]"
+             << " [--flat-ast | --fused | --pipeline | --streaming]"
+             << " <input> <output>" << endl;
         return 1;
     }
 
-    Parser parser;
-    Ptr<ProgramNode> program = parser.ParseFile(argv[1]);
+    // Functions are parsed in parallel from the tokens of the whole file,
+    // and the pipeline needs all names interned before it starts.
+    if ((parallel_parse || pipelined) && scan_mode == kScanStreaming)
+        scan_mode = kScanEager;
+
+    Parser parser(scan_mode);
+    parser.SetScanThreads(num_threads);
+    if (parallel_parse)
+        parser.SetParseThreads(num_threads);
+    TypeChecker checker(files[0]);
+    if (parallel_check)
+        checker.SetThreads(num_threads);
+    std::ofstream out;
+    Compiler compiler(out);
+    if (parallel_codegen)
+        compiler.SetThreads(num_threads);
+    ConstFolder folder;
+    ConstFolder *const folder_if_optimized = optimize ? &folder : nullptr;
 
-    TypeChecker checker(parser.Filename());
-    program->Accept(checker);
+    auto open_output = [&](const std::string &filename) {
+        out.open(filename);
+        if (!out.is_open()) {
+            cout << "Cannot open the file " << filename << endl;
+        }
+    };
 
-    std::ofstream out(argv[2]);
+    // The fused front end checks and allocates while parsing, the pipeline
+    // also generates the code of the functions, and the streaming front end
+    // writes it out as well.
+    Ptr<ProgramNode> program;
+    std::unique_ptr<Pipeline> pipeline;
+    if (fused) {
+        FusedFrontEnd front_end(checker, compiler);
+        checker.SetParser(&parser);
+        program = parser.ParseFile(files[0], &front_end);
+    } else if (pipelined) {
+        pipeline = std::make_unique<Pipeline>(checker, compiler, num_threads);
+        pipeline->SetFolding(optimize);
+        program = pipeline->Run(parser, files[0]);
+    } else if (streaming) {
+        partial_output = files[1] + ".partial";
+        atexit(RemovePartialOutput);
+        open_output(partial_output);
 
-    if (!out.is_open()) {
-        cout << "Cannot open the file " << argv[2] << endl;
+        StreamingFrontEnd front_end(checker, compiler, folder_if_optimized);
+        checker.SetParser(&parser);
+        parser.SetReleaseFuncDefs(true);
+        program = parser.ParseFile(files[0], &front_end);
+        front_end.Finish(program.get());
+
+        out.close();
+        if (std::rename(partial_output.c_str(), files[1].c_str()) != 0) {
+            cout << "Cannot write the file " << files[1] << endl;
+            return 1;
+        }
+        partial_output.clear();
+    } else {
+        program = parser.ParseFile(files[0]);
+    }
+
+    // The flat form replaces the tree for the remaining passes.
+    FlatAst flat;
+    if (flat_ast) {
+        flat = Flatten(*program);
+        program.reset();
+    }
+
+    if (flat_ast) {
+        checker.Check(flat);
+    } else if (!pipelined && !streaming) {
+        if (!fused)
+            program->Accept(checker);
+        if (optimize)
+            folder.Fold(program.get());
+    }
+
+    if (!streaming)
+        open_output(files[1]);
+    if (fused) {
+        compiler.Generate(program.get());
+    } else if (pipelined) {
+        pipeline->Assemble(program.get());
+    } else if (flat_ast) {
+        compiler.Compile(flat);
+    } else if (!streaming) {
+        compiler.Compile(program.get());
     }
-    Compiler compiler(out);
-    compiler.Compile(program.get());
 
     cout << "No errors found" << endl;
 
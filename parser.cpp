@@ -1,9 +1,19 @@
 #include "parser.h"
 
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
 #include <utility>
 
+#include "thread_pool.h"
+
+namespace {
+
+// Thrown by Parser::Error() in a parser that does not exit on errors.
+struct SyntaxError {};
+
+} // namespace
+
 static int GetOpPrecedence(TokenType op) {
     switch (op) {
     case kAs:
@@ -46,26 +56,95 @@ static bool IsBinaryOp(TokenType tk) {
     }
 }
 
-Ptr<ProgramNode> Parser::ParseFile(const std::string &filename) {
+static bool TypeFromName(std::string_view name, VarType &type) {
+    if (name == "int") {
+        type = kInt;
+    } else if (name == "double") {
+        type = kDouble;
+    } else if (name == "void") {
+        type = kVoid;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+Ptr<ProgramNode> Parser::ParseFile(const std::string &filename, ParseListener *listener) {
     scanner_.ScanFile(filename);
+    listener_ = listener;
+    Ptr<ProgramNode> program = ParseProgram();
+    listener_ = nullptr;
+    return program;
+}
+
+Ptr<ProgramNode> Parser::ParseTokens(const std::string &filename,
+                                     std::shared_ptr<SourceBuffer> source, TokenStore tokens) {
+    scanner_.LoadTokens(filename, std::move(source), std::move(tokens));
+    return ParseProgram();
+}
+
+Ptr<ProgramNode> Parser::ParseProgram() {
     Ptr<ProgramNode> program = std::make_unique<ProgramNode>();
+    program->source = scanner_.Source();
+    arena_ = &program->arena;
+    in_func_defs_ = false;
+
+    if (listener_)
+        listener_->OnSignatures(program->source, ScanSignatures());
+
+    program->global_vars = ParseGlobalVars();
+    program->functions = ParseFuncDefs();
+
+    arena_ = nullptr;
+    return program;
+}
 
+Span<DeclStmtNode *> Parser::ParseGlobalVars() {
+    const size_t first = node_stack_.size();
     while (true) {
         const Token &tk = scanner_.Peek(0);
+        DeclStmtNode *var = nullptr;
         if (tk.type == kLet) {
-            program->global_vars.push_back(ParseDeclStmt(false));
+            var = ParseDeclStmt(false);
         } else if (tk.type == kConst) {
-            program->global_vars.push_back(ParseDeclStmt(true));
+            var = ParseDeclStmt(true);
         } else if (tk.type == kFn) {
             break;
         } else {
             error_ << "Unexpected token " << TokenToString(scanner_.Peek(0).type);
             Error(scanner_.Peek(0).pos);
         }
+
+        node_stack_.push_back(var);
+        if (listener_)
+            listener_->OnGlobalVar(var);
     }
 
+    return PopNodes<DeclStmtNode>(first);
+}
+
+// The functions up to the end of the file.
+Span<FuncDefNode *> Parser::ParseFuncDefs() {
+    in_func_defs_ = true;
+
+    const size_t first = node_stack_.size();
+    if (parse_threads_ > 1 && scanner_.Mode() != kScanStreaming && !listener_)
+        ParseFuncDefsParallel();
+
     while (scanner_.Peek(0).type == kFn) {
-        program->functions.push_back(ParseFuncDef());
+        if (release_func_defs_ && listener_) {
+            Arena *program_arena = arena_;
+            arena_ = &func_arena_;
+            listener_->OnFuncDef(ParseFuncDef());
+            arena_ = program_arena;
+            func_arena_.Reset();
+            continue;
+        }
+
+        FuncDefNode *func = ParseFuncDef();
+        node_stack_.push_back(func);
+        if (listener_)
+            listener_->OnFuncDef(func);
     }
 
     if (scanner_.Peek(0).type != kEof) {
@@ -74,11 +153,185 @@ Ptr<ProgramNode> Parser::ParseFile(const std::string &filename) {
         Error(scanner_.Peek(0).pos);
     }
 
-    return program;
+    return PopNodes<FuncDefNode>(first);
+}
+
+// Cut the tokens at the 'fn's outside of braces and parse the functions in
+// chunks on a thread pool, each chunk with a parser and arena of its own.
+// Every function has to end right where the next one starts. The functions
+// up to the first one that does not, or that has a syntax error, go onto
+// node_stack_, and the scanner is left at that one for ParseFuncDefs() to
+// parse the rest serially. This way errors are those of a serial parse.
+void Parser::ParseFuncDefsParallel() {
+    const size_t first_token = scanner_.TokenIndex();
+    std::vector<size_t> bounds = scanner_.FindTopLevelFnTokens(first_token);
+    if (bounds.empty() || bounds[0] != first_token)
+        return;
+
+    const size_t num_funcs = bounds.size();
+    bounds.push_back(scanner_.NumTokens());
+
+    // A few chunks per thread of about the same number of tokens, so that
+    // a long function does not hold up the others for long.
+    const size_t num_chunks = std::min<size_t>(num_funcs, parse_threads_ * 4);
+    const size_t num_tokens = bounds.back() - first_token;
+    std::vector<size_t> chunk_bounds{0};
+    for (size_t i = 1; i < num_chunks; ++i) {
+        size_t token = first_token + num_tokens / num_chunks * i;
+        size_t func = std::lower_bound(bounds.begin(), bounds.end() - 1, token) - bounds.begin();
+        if (func > chunk_bounds.back() && func < num_funcs)
+            chunk_bounds.push_back(func);
+    }
+    chunk_bounds.push_back(num_funcs);
+
+    struct Chunk {
+        Parser parser;
+        Arena arena;
+        std::vector<FuncDefNode *> funcs;
+        size_t failed = 0;          // The first function that did not parse.
+    };
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    ThreadPool pool(std::min<size_t>(parse_threads_, chunk_bounds.size() - 1));
+    for (size_t i = 0; i + 1 < chunk_bounds.size(); ++i) {
+        chunks.push_back(std::make_unique<Chunk>());
+        Chunk *chunk = chunks.back().get();
+        const size_t first = chunk_bounds[i];
+        const size_t last = chunk_bounds[i + 1];
+        pool.Submit([this, chunk, &bounds, first, last] {
+            chunk->parser.arena_ = &chunk->arena;
+            chunk->parser.exit_on_error_ = false;
+            chunk->failed = chunk->parser.ParseFuncRange(scanner_, bounds, first, last, chunk->funcs);
+        });
+    }
+    pool.Wait();
+
+    size_t failed = num_funcs;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        Chunk &chunk = *chunks[i];
+        arena_->Adopt(chunk.arena);
+        node_stack_.insert(node_stack_.end(), chunk.funcs.begin(), chunk.funcs.end());
+        if (chunk.failed < chunk_bounds[i + 1]) {
+            failed = chunk.failed;
+            break;
+        }
+    }
+
+    scanner_.SeekToken(bounds[failed]);
+}
+
+// Parse the functions first to last - 1, function i being the tokens from
+// bounds[i] to bounds[i + 1]. Returns the first function that does not
+// parse or does not end at its bound, or `last`.
+size_t Parser::ParseFuncRange(const Scanner &tokens, const std::vector<size_t> &bounds,
+                              size_t first, size_t last, std::vector<FuncDefNode *> &funcs) {
+    for (size_t i = first; i < last; ++i) {
+        scanner_.ShareTokens(tokens, bounds[i], bounds[i + 1]);
+        try {
+            funcs.push_back(ParseFuncDef());
+        } catch (const SyntaxError &) {
+            return i;
+        }
+
+        if (scanner_.Peek(0).type != kEof) {
+            funcs.pop_back();
+            return i;
+        }
+    }
+    return last;
+}
+
+void Parser::SkipRest() {
+    listener_ = nullptr;
+    if (!in_func_defs_)
+        ParseGlobalVars();
+    ParseFuncDefs();
+}
+
+// Find `fn name(params) -> type` outside of braces ahead of the parser.
+// Only the signatures are scanned into tokens. Nothing is reported here: a
+// signature that does not scan is left out, and the parser reports the
+// error when it gets there.
+Span<FuncDefNode *> Parser::ScanSignatures() {
+    const size_t first = node_stack_.size();
+    Scanner scanner;
+    for (uint32_t offset : FindTopLevelFns(scanner_.Source()->Text())) {
+        scanner.ScanSource(scanner_.Source(), offset);
+        if (FuncDefNode *func = ScanSignature(scanner))
+            node_stack_.push_back(func);
+    }
+    return PopNodes<FuncDefNode>(first);
+}
+
+// Scan the signature at the 'fn' the scanner starts at, the same way
+// ParseFuncDef() and ParseParams() parse it.
+FuncDefNode *Parser::ScanSignature(Scanner &scanner) {
+    const size_t first = node_stack_.size();
+    auto fail = [&]() -> FuncDefNode * {
+        node_stack_.resize(first);
+        return nullptr;
+    };
+    auto next = [&] { return scanner.GetToken(); };
+
+    next();                 // Skip 'fn'
+    FuncDefNode *func = arena_->New<FuncDefNode>();
+    Token tk = next();
+    if (tk.type != kIdent)
+        return fail();
+    func->pos = tk.pos;
+    func->name = tk.sym;
+
+    if ((tk = next()).type != kL_paren)
+        return fail();
+
+    tk = next();
+    while (tk.type == kConst || tk.type == kIdent) {
+        DeclStmtNode *param = arena_->New<DeclStmtNode>();
+        if (tk.type == kConst) {
+            param->is_const = true;
+            tk = next();
+        }
+
+        if (tk.type != kIdent)
+            return fail();
+        param->pos = tk.pos;
+        param->name = tk.sym;
+
+        if ((tk = next()).type != kColon)
+            return fail();
+        tk = next();
+        if (tk.type != kIdent || !TypeFromName(tk.lexeme, param->type) || param->type == kVoid)
+            return fail();
+        node_stack_.push_back(param);
+
+        if ((tk = next()).type != kComma)
+            break;
+        tk = next();
+    }
+
+    if (tk.type != kR_paren || (tk = next()).type != kArrow)
+        return fail();
+    tk = next();
+    if (tk.type != kIdent || !TypeFromName(tk.lexeme, func->return_type))
+        return fail();
+
+    func->params = PopNodes<DeclStmtNode>(first);
+    return func;
+}
+
+// Move the nodes pushed since node_stack_[first] into an arena array. The
+// stack is shared by all lists, nested ones are always complete before the
+// list around them continues.
+template <typename T>
+Span<T *> Parser::PopNodes(size_t first) {
+    Span<T *> nodes = arena_->NewArray<T *>(node_stack_.size() - first);
+    for (size_t i = 0; i < nodes.size(); ++i)
+        nodes[i] = static_cast<T *>(node_stack_[first + i]);
+    node_stack_.resize(first);
+    return nodes;
 }
 
-Ptr<StmtNode> Parser::ParseStmt(FuncDefNode *func) {
-    Ptr<StmtNode> stmt;
+StmtNode *Parser::ParseStmt(FuncDefNode *func) {
+    StmtNode *stmt = nullptr;
 
     switch (scanner_.Peek(0).type) {
     case kLet:
@@ -107,13 +360,13 @@ Ptr<StmtNode> Parser::ParseStmt(FuncDefNode *func) {
     return stmt;
 }
 
-Ptr<FuncDefNode> Parser::ParseFuncDef() {
+FuncDefNode *Parser::ParseFuncDef() {
     ConsumeToken();         // Skip 'fn'
     ExpectToken(kIdent);
-    Ptr<FuncDefNode> func = std::make_unique<FuncDefNode>();
+    FuncDefNode *func = arena_->New<FuncDefNode>();
     func->pos = scanner_.Peek(0).pos;
 
-    func->name = scanner_.Peek(0).lexeme;
+    func->name = scanner_.Peek(0).sym;
     ConsumeToken();         // Skip the function name
 
     ConsumeToken(kL_paren);
@@ -123,18 +376,19 @@ Ptr<FuncDefNode> Parser::ParseFuncDef() {
     ConsumeToken(kArrow);
     func->return_type = ParseType();
 
-    func->body = ParseBlockStmt(func.get());
+    func->body = ParseBlockStmt(func);
     func->body->is_func_body = true;
 
     return func;
 }
 
-Ptr<DeclStmtNode> Parser::ParseDeclStmt(bool is_const) {
-    auto stmt = std::make_unique<DeclStmtNode>();
+DeclStmtNode *Parser::ParseDeclStmt(bool is_const) {
+    auto stmt = arena_->New<DeclStmtNode>();
     stmt->pos = scanner_.Peek(0).pos;
 
     ConsumeToken();         // Skip 'let' or 'const'
-    stmt->name = scanner_.Peek(0).lexeme;
+    ExpectToken(kIdent);
+    stmt->name = scanner_.Peek(0).sym;
     ConsumeToken();         // Skip the variable name.
     ConsumeToken(kColon);
     stmt->type = ParseVarType();
@@ -146,7 +400,7 @@ Ptr<DeclStmtNode> Parser::ParseDeclStmt(bool is_const) {
 
     if (is_const) {
         if (!stmt->initializer) {
-            error_ << "Uninitialized constat " << stmt->name;
+            error_ << "Uninitialized constat " << SymbolName(stmt->name);
             Error(stmt->pos);    // Constant must be initialized.
         }
         stmt->is_const = true;
@@ -157,165 +411,192 @@ Ptr<DeclStmtNode> Parser::ParseDeclStmt(bool is_const) {
     return stmt;
 }
 
-Ptr<BlockStmtNode> Parser::ParseBlockStmt(FuncDefNode *func) {
+BlockStmtNode *Parser::ParseBlockStmt(FuncDefNode *func) {
     ConsumeToken(kL_brace);
-    auto stmt = std::make_unique<BlockStmtNode>();
+    auto stmt = arena_->New<BlockStmtNode>();
     stmt->pos = scanner_.Peek(0).pos;
 
+    const size_t first = node_stack_.size();
     while (scanner_.Peek(0).type != kR_brace) {
-        stmt->statements.push_back(ParseStmt(func));
+        node_stack_.push_back(ParseStmt(func));
     }
+    stmt->statements = PopNodes<StmtNode>(first);
     ConsumeToken(kR_brace);
     return stmt;
 }
 
-Ptr<ExprStmtNode> Parser::ParseExprStmt() {
-    auto stmt = std::make_unique<ExprStmtNode>();
+ExprStmtNode *Parser::ParseExprStmt() {
+    auto stmt = arena_->New<ExprStmtNode>();
     stmt->pos = scanner_.Peek(0).pos;
     stmt->expr = ParseExpression();
     ConsumeToken(kSemicolon);
     return stmt;
 }
 
-Ptr<ExprNode> Parser::ParseExpression(int min_precedence) {
-    TokenType tk1 = scanner_.Peek(0).type;
-    TokenType tk2 = scanner_.Peek(1).type;
+// Precedence climbing without recursion. Everything that is waiting for an
+// operand is an ExprFrame on expr_stack_: a binary operator waiting for its
+// right operand, a '-' or an assignment waiting for theirs, an open
+// parenthesis, or a call waiting for its next argument. All but the binary
+// operators take a whole expression, which starts over at
+// kMinBinaryOpPrecedence. The trees are the same as those of the recursive
+// descent this replaces, but deep expressions only grow expr_stack_.
+ExprNode *Parser::ParseExpression(int min_precedence) {
+    const size_t base = expr_stack_.size();
+    ExprNode *operand = nullptr;
 
-    Ptr<ExprNode> left;
-    switch (tk1) {
-    case kL_paren:
-        ConsumeToken();
-        left = ParseExpression(kMinBinaryOpPrecedence);
-        ConsumeToken(kR_paren);
-        break;
-    case kMinus:
-        left = ParseNegateExpr();
-        break;
-    case kIntLiteral:
-        left = ParseLiteralExpr(kInt);
-        break;
-    case kDoubleLiteral:
-        left = ParseLiteralExpr(kDouble);
-        break;
-    case kIdent:
-        switch (tk2) {
-        case kL_paren:
-            left = ParseFuncCall();
-            break;
-        case kAssign:
-            left = ParseAssignExpr();
-            break;
-        default:
-            left = ParseIdentExpr();
-            break;
-        }
-        break;
-    default:
-        error_ << "Invalid expression";
-        Error(scanner_.Peek(0).pos);
-        break;
-    }
-
-    return ParseBinaryOpExpr(std::move(left), min_precedence);
-}
-
-Ptr<ExprNode> Parser::ParseBinaryOpExpr(Ptr<ExprNode> left, int min_precedence) {
     while (true) {
-        TokenType op = scanner_.Peek(0).type;
-        int precedence = GetOpPrecedence(op);
-        if (!IsBinaryOp(op) || precedence < min_precedence)
-            break;
-
-        Ptr<OperatorExprNode> expr = std::make_unique<OperatorExprNode>();
-        expr->pos = scanner_.Peek(0).pos;
-
-        expr->left = std::move(left);
-        expr->op = op;
-        ConsumeToken();     // Skip the operator.
-        expr->right = ParseExpression(precedence + 1);
+        // Parse the prefixes of an operand up to a primary expression.
+        while (operand == nullptr) {
+            TokenType tk1 = scanner_.Peek(0).type;
+            TokenType tk2 = scanner_.Peek(1).type;
+
+            switch (tk1) {
+            case kL_paren:
+                ConsumeToken();
+                expr_stack_.push_back({nullptr, min_precedence, 0});
+                min_precedence = kMinBinaryOpPrecedence;
+                break;
+            case kMinus: {
+                NegateExpr *expr = arena_->New<NegateExpr>();
+                expr->pos = scanner_.Peek(0).pos;
+                ConsumeToken();     // Skip '-'
+                expr_stack_.push_back({expr, min_precedence, 0});
+                min_precedence = kMinBinaryOpPrecedence;
+                break;
+            }
+            case kIntLiteral:
+                operand = ParseLiteralExpr(kInt);
+                break;
+            case kDoubleLiteral:
+                operand = ParseLiteralExpr(kDouble);
+                break;
+            case kIdent:
+                if (tk2 == kL_paren) {
+                    CallExprNode *expr = arena_->New<CallExprNode>();
+                    expr->func_name = scanner_.Peek(0).sym;
+                    expr->pos = scanner_.Peek(0).pos;
+                    ConsumeToken();
+                    ConsumeToken(kL_paren);     // Skip '('
+                    if (scanner_.Peek(0).type == kR_paren) {
+                        ConsumeToken();         // Skip ')'
+                        operand = expr;
+                    } else {
+                        expr_stack_.push_back({expr, min_precedence, node_stack_.size()});
+                        min_precedence = kMinBinaryOpPrecedence;
+                    }
+                } else if (tk2 == kAssign) {
+                    AssignExprNode *expr = arena_->New<AssignExprNode>();
+                    expr->lhs = scanner_.Peek(0).sym;
+                    ConsumeToken();
+                    expr->pos = scanner_.Peek(0).pos;
+                    ConsumeToken();     // Skip '='
+                    expr_stack_.push_back({expr, min_precedence, 0});
+                    min_precedence = kMinBinaryOpPrecedence;
+                } else {
+                    operand = ParseIdentExpr();
+                }
+                break;
+            default:
+                error_ << "Invalid expression";
+                Error(scanner_.Peek(0).pos);
+                break;
+            }
+        }
 
-        left = std::move(expr);
+        // Extend the operand with binary operators, then hand it to the
+        // frames it completes.
+        while (operand != nullptr) {
+            TokenType op = scanner_.Peek(0).type;
+            int precedence = GetOpPrecedence(op);
+            if (IsBinaryOp(op) && precedence >= min_precedence) {
+                OperatorExprNode *expr = arena_->New<OperatorExprNode>();
+                expr->pos = scanner_.Peek(0).pos;
+                expr->left = operand;
+                expr->op = op;
+                ConsumeToken();     // Skip the operator.
+
+                expr_stack_.push_back({expr, min_precedence, 0});
+                min_precedence = precedence + 1;
+                operand = nullptr;
+                continue;
+            }
+
+            if (expr_stack_.size() == base)
+                return operand;
+
+            const ExprFrame frame = expr_stack_.back();
+            expr_stack_.pop_back();
+            min_precedence = frame.min_precedence;
+
+            if (frame.node == nullptr) {
+                ConsumeToken(kR_paren);
+                continue;
+            }
+
+            switch (frame.node->kind) {
+            case kOperatorExprNode:
+                static_cast<OperatorExprNode *>(frame.node)->right = operand;
+                break;
+            case kNegateExpr:
+                static_cast<NegateExpr *>(frame.node)->operand = operand;
+                break;
+            case kAssignExprNode:
+                static_cast<AssignExprNode *>(frame.node)->rhs = operand;
+                break;
+            case kCallExprNode:
+                node_stack_.push_back(operand);
+                if (scanner_.Peek(0).type == kComma) {
+                    ConsumeToken();     // Skip ','
+                    expr_stack_.push_back(frame);
+                    min_precedence = kMinBinaryOpPrecedence;
+                    operand = nullptr;
+                    continue;
+                }
+                static_cast<CallExprNode *>(frame.node)->args = PopNodes<ExprNode>(frame.first_arg);
+                ConsumeToken(kR_paren);     // Skip ')'
+                break;
+            default:
+                break;
+            }
+            operand = frame.node;
+        }
     }
-
-    return left;
-}
-
-Ptr<ExprNode> Parser::ParseNegateExpr() {
-    Ptr<NegateExpr> expr = std::make_unique<NegateExpr>();
-    expr->pos = scanner_.Peek(0).pos;
-
-    ConsumeToken(kMinus);
-    expr->operand = ParseExpression();
-
-    return expr;
-}
-
-Ptr<ExprNode> Parser::ParseAssignExpr() {
-    Ptr<AssignExprNode> expr = std::make_unique<AssignExprNode>();
-    expr->lhs = scanner_.Peek(0).lexeme;
-    ConsumeToken();
-    expr->pos = scanner_.Peek(0).pos;
-    ConsumeToken(kAssign); // Skip '='
-    expr->rhs = ParseExpression();
-
-    return expr;
 }
 
-Ptr<ExprNode> Parser::ParseLiteralExpr(VarType type) {
-    Ptr<LiteralExprNode> expr = std::make_unique<LiteralExprNode>();
+ExprNode *Parser::ParseLiteralExpr(VarType type) {
+    LiteralExprNode *expr = arena_->New<LiteralExprNode>();
     expr->pos = scanner_.Peek(0).pos;
     expr->type.type = type;
     expr->type.is_const = true;
-    expr->lexeme = scanner_.GetToken().lexeme;
-
-    return expr;
-}
-
-Ptr<ExprNode> Parser::ParseIdentExpr() {
-    Ptr<IdentExprNode> expr = std::make_unique<IdentExprNode>();
-    expr->pos = scanner_.Peek(0).pos;
-    expr->var_name = scanner_.Peek(0).lexeme;
-    ConsumeToken();
-
-    return expr;
-}
-
-PtrVec<ExprNode> Parser::ParseArgs() {
-    PtrVec<ExprNode> args;
-    if (scanner_.Peek(0).type == kR_paren)
-        return args;
-
-    while (true) {
-        args.push_back(ParseExpression());
 
-        if (scanner_.Peek(0).type == kComma) {
-            ConsumeToken();     // Skip ','
-        } else {
-            break;
-        }
+    const Token &tk = scanner_.GetToken();
+    expr->lexeme = tk.lexeme;
+    if (type == kInt) {
+        expr->type.int_value = tk.int_value;
+    } else {
+        expr->type.double_value = tk.double_value;
     }
 
-    return args;
+    return expr;
 }
 
-Ptr<ExprNode> Parser::ParseFuncCall() {
-    auto expr = std::make_unique<CallExprNode>();
-    expr->func_name = scanner_.Peek(0).lexeme;
+ExprNode *Parser::ParseIdentExpr() {
+    IdentExprNode *expr = arena_->New<IdentExprNode>();
     expr->pos = scanner_.Peek(0).pos;
+    expr->var_name = scanner_.Peek(0).sym;
     ConsumeToken();
-    ConsumeToken(kL_paren);     // Skip '('
-    expr->args = ParseArgs();
-    ConsumeToken(kR_paren);     // Skip ')'
+
     return expr;
 }
 
-Ptr<IfStmtNode> Parser::ParseIfStmt(FuncDefNode *func) {
-    auto stmt = std::make_unique<IfStmtNode>();
+IfStmtNode *Parser::ParseIfStmt(FuncDefNode *func) {
+    auto stmt = arena_->New<IfStmtNode>();
     stmt->pos = scanner_.Peek(0).pos;
     ConsumeToken();         // Skip if
     stmt->if_part.condition = ParseExpression();
     stmt->if_part.body = ParseBlockStmt(func);
 
+    const size_t first = cond_stack_.size();
     while (scanner_.Peek(0).type == kElse) {
         ConsumeToken();         // Skip else
         TokenType tk = scanner_.Peek(0).type;
@@ -328,17 +609,21 @@ Ptr<IfStmtNode> Parser::ParseIfStmt(FuncDefNode *func) {
             cond_body.condition = ParseExpression();
             cond_body.body = ParseBlockStmt(func);
 
-            stmt->elif_part.push_back(std::move(cond_body));
+            cond_stack_.push_back(cond_body);
         } else {
             error_ << "Expected an 'if' or '{'";
             Error(scanner_.Peek(0).pos);
         }
     }
+
+    stmt->elif_part = arena_->NewArray<CondBody>(cond_stack_.size() - first);
+    std::copy(cond_stack_.begin() + first, cond_stack_.end(), stmt->elif_part.begin());
+    cond_stack_.resize(first);
     return stmt;
 }
 
-Ptr<WhileStmtNode> Parser::ParseWhileStmt(FuncDefNode *func) {
-    auto stmt = std::make_unique<WhileStmtNode>();
+WhileStmtNode *Parser::ParseWhileStmt(FuncDefNode *func) {
+    auto stmt = arena_->New<WhileStmtNode>();
     stmt->pos = scanner_.Peek(0).pos;
 
     ConsumeToken();
@@ -347,8 +632,8 @@ Ptr<WhileStmtNode> Parser::ParseWhileStmt(FuncDefNode *func) {
     return stmt;
 }
 
-Ptr<ReturnStmtNode> Parser::ParseReturnStmt(FuncDefNode *func) {
-    auto stmt = std::make_unique<ReturnStmtNode>();
+ReturnStmtNode *Parser::ParseReturnStmt(FuncDefNode *func) {
+    auto stmt = arena_->New<ReturnStmtNode>();
     stmt->pos = scanner_.Peek(0).pos;
     stmt->func = func;
     ConsumeToken();
@@ -362,15 +647,15 @@ Ptr<ReturnStmtNode> Parser::ParseReturnStmt(FuncDefNode *func) {
     return stmt;
 }
 
-PtrVec<DeclStmtNode>  Parser::ParseParams() {
-    PtrVec<DeclStmtNode> params;
+Span<DeclStmtNode *> Parser::ParseParams() {
+    const size_t first = node_stack_.size();
 
     while (true) {
         TokenType tk = scanner_.Peek(0).type;
         if (tk != kConst && tk != kIdent)
             break;
 
-        Ptr<DeclStmtNode> param = std::make_unique<DeclStmtNode>();
+        DeclStmtNode *param = arena_->New<DeclStmtNode>();
         if (tk == kConst) {
             ConsumeToken();
             param->is_const = true;
@@ -378,12 +663,12 @@ PtrVec<DeclStmtNode>  Parser::ParseParams() {
 
         param->pos = scanner_.Peek(0).pos;
         ExpectToken(kIdent);
-        param->name = scanner_.Peek(0).lexeme;
+        param->name = scanner_.Peek(0).sym;
         ConsumeToken();
         ConsumeToken(kColon);
         param->type = ParseVarType();
 
-        params.push_back(std::move(param));
+        node_stack_.push_back(param);
 
         if (scanner_.Peek(0).type == kComma) {
             ConsumeToken();
@@ -391,22 +676,14 @@ PtrVec<DeclStmtNode>  Parser::ParseParams() {
             break;
         }
     }
-    return params;
+    return PopNodes<DeclStmtNode>(first);
 }
 
 VarType Parser::ParseType() {
     ExpectToken(kIdent);
 
-    const std::string &type_name = scanner_.Peek(0).lexeme;
     VarType type = kVoid;
-
-    if (type_name == "int") {
-        type = kInt;
-    } else if (type_name == "double") {
-        type = kDouble;
-    } else if (type_name == "void") {
-        type = kVoid;
-    } else {
+    if (!TypeFromName(scanner_.Peek(0).lexeme, type)) {
         error_ << "Expected a type specifier, got"
                << scanner_.Peek(0).lexeme;
         Error(scanner_.Peek(0).pos);
@@ -420,7 +697,7 @@ VarType Parser::ParseType() {
 VarType Parser::ParseVarType() {
     ExpectToken(kIdent);
 
-    const std::string &type_name = scanner_.Peek(0).lexeme;
+    std::string_view type_name = scanner_.Peek(0).lexeme;
     VarType type = kVoid;
 
     if (type_name == "int") {
@@ -452,9 +729,14 @@ void Parser::ConsumeToken(TokenType type) {
 }
 
 void Parser::Error(Position pos) {
+    if (!exit_on_error_)
+        throw SyntaxError();
+
+    if (listener_)
+        listener_->OnSyntaxError();
     std::cout << Filename() << ":"
-              << pos.LineNo() << ":"
-              << pos.ColNo() << ": syntax error: "
+              << scanner_.Source()->LineNo(pos) << ":"
+              << scanner_.Source()->ColNo(pos) << ": syntax error: "
               << error_.str()
               << std::endl;
     exit(1);
@@ -6,33 +6,76 @@
 
 constexpr int kMinBinaryOpPrecedence = 2;
 
+// Gets the parts of a program in program order while it is parsed, so that
+// later passes can run on each part as soon as it is complete.
+class ParseListener {
+public:
+    // The functions of the whole file, found by a quick scan before parsing
+    // starts. The nodes only have a name, parameters and a return type.
+    virtual void OnSignatures(const std::shared_ptr<SourceBuffer> &source,
+                              Span<FuncDefNode *> functions) = 0;
+    virtual void OnGlobalVar(DeclStmtNode *var) = 0;
+    virtual void OnFuncDef(FuncDefNode *func) = 0;
+
+    // Called before the parser exits on a syntax error.
+    virtual void OnSyntaxError() {}
+};
+
 class Parser {
 public:
-    Ptr<ProgramNode> ParseFile(const std::string &filename);
+    explicit Parser(ScanMode scan_mode = kScanStreaming) : scanner_(scan_mode) {}
+
+    void SetScanThreads(unsigned num_threads) { scanner_.SetThreads(num_threads); }
+
+    // Parse the functions on this many threads. Only used when the scanner
+    // is in an eager mode and there is no ParseListener.
+    void SetParseThreads(unsigned num_threads) { parse_threads_ = num_threads; }
+
+    // Parse each function into an arena of its own that is reset once the
+    // ParseListener has seen the function, so that memory grows with the
+    // largest function instead of the program. ProgramNode::functions is
+    // left empty.
+    void SetReleaseFuncDefs(bool release) { release_func_defs_ = release; }
+
+    Ptr<ProgramNode> ParseFile(const std::string &filename, ParseListener *listener = nullptr);
+
+    // Parse tokens that were scanned beforehand, e.g. by an IncrementalScanner.
+    Ptr<ProgramNode> ParseTokens(const std::string &filename,
+                                 std::shared_ptr<SourceBuffer> source, TokenStore tokens);
     const std::string &Filename() const { return scanner_.Filename(); }
 
+    // Parse the rest of the file without the listener, only to report the
+    // syntax errors in it. For a listener that is about to exit with an
+    // error of its own, which must not win over an earlier syntax error.
+    void SkipRest();
+
 private:
-    PtrVec<StmtNode> ParseStmtList(FuncDefNode *func);
-    Ptr<StmtNode> ParseStmt(FuncDefNode *func);
-    Ptr<FuncDefNode> ParseFuncDef();
-    Ptr<DeclStmtNode> ParseDeclStmt(bool is_const);
-    Ptr<BlockStmtNode> ParseBlockStmt(FuncDefNode *func);
-    Ptr<ExprStmtNode> ParseExprStmt();
-    Ptr<IfStmtNode> ParseIfStmt(FuncDefNode *func);
-    Ptr<WhileStmtNode> ParseWhileStmt(FuncDefNode *func);
-    Ptr<ReturnStmtNode> ParseReturnStmt(FuncDefNode *func);
-    PtrVec<DeclStmtNode> ParseParams();
-    Ptr<ExprNode> ParseExpression(int min_precedence=kMinBinaryOpPrecedence);
-    Ptr<ExprNode> ParseBinaryOpExpr(Ptr<ExprNode> left, int min_precedence);
-    Ptr<ExprNode> ParseNegateExpr();
-    Ptr<ExprNode> ParseAssignExpr();
-    Ptr<ExprNode> ParseLiteralExpr(VarType type);
-    Ptr<ExprNode> ParseIdentExpr();
-    Ptr<ExprNode> ParseFactor();
-    PtrVec<ExprNode> ParseArgs();
-    Ptr<ExprNode> ParseFuncCall();
+    Ptr<ProgramNode> ParseProgram();
+    Span<DeclStmtNode *> ParseGlobalVars();
+    Span<FuncDefNode *> ParseFuncDefs();
+    void ParseFuncDefsParallel();
+    size_t ParseFuncRange(const Scanner &tokens, const std::vector<size_t> &bounds,
+                          size_t first, size_t last, std::vector<FuncDefNode *> &funcs);
+    Span<FuncDefNode *> ScanSignatures();
+    FuncDefNode *ScanSignature(Scanner &scanner);
+    Span<StmtNode *> ParseStmtList(FuncDefNode *func);
+    StmtNode *ParseStmt(FuncDefNode *func);
+    FuncDefNode *ParseFuncDef();
+    DeclStmtNode *ParseDeclStmt(bool is_const);
+    BlockStmtNode *ParseBlockStmt(FuncDefNode *func);
+    ExprStmtNode *ParseExprStmt();
+    IfStmtNode *ParseIfStmt(FuncDefNode *func);
+    WhileStmtNode *ParseWhileStmt(FuncDefNode *func);
+    ReturnStmtNode *ParseReturnStmt(FuncDefNode *func);
+    Span<DeclStmtNode *> ParseParams();
+    ExprNode *ParseExpression(int min_precedence=kMinBinaryOpPrecedence);
+    ExprNode *ParseLiteralExpr(VarType type);
+    ExprNode *ParseIdentExpr();
     // Ptr<ArrayExprNode> ParseArrayLiteral();
 
+    template <typename T>
+    Span<T *> PopNodes(size_t first);
+
     VarType ParseType();
     VarType ParseVarType();
     void ExpectToken(TokenType);
@@ -41,8 +84,28 @@ private:
     void Error(Position pos);
 
 private:
+    // A node of an expression waiting for an operand, see ParseExpression().
+    struct ExprFrame {
+        ExprNode *node;             // nullptr for an open parenthesis.
+        int min_precedence;         // Of the expression around the node.
+        size_t first_arg;           // Of a call, in node_stack_.
+    };
+
     std::ostringstream error_;
     Scanner scanner_;
+
+    Arena *arena_ = nullptr;                // Of the program being parsed.
+    Arena func_arena_;                      // See SetReleaseFuncDefs().
+    bool release_func_defs_ = false;
+    std::vector<Node *> node_stack_;        // Children of the lists being parsed.
+    std::vector<CondBody> cond_stack_;      // Else-if parts of the if statements being parsed.
+    std::vector<ExprFrame> expr_stack_;     // Of the expression being parsed.
+
+    ParseListener *listener_ = nullptr;
+    bool in_func_defs_ = false;             // Past the global variables.
+
+    unsigned parse_threads_ = 1;
+    bool exit_on_error_ = true;             // Or throw, in the parsers of ParseFuncDefsParallel().
 };
 
 #endif // PARSER_H_
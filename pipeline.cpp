@@ -0,0 +1,98 @@
+#include "pipeline.h"
+
+struct Pipeline::Worker {
+    Worker(const TypeChecker &parent_checker, const Compiler &parent_compiler)
+        : checker(TypeChecker::WorkerTag(), parent_checker),
+          compiler(Compiler::WorkerTag(), parent_compiler) {}
+
+    TypeChecker checker;
+    ConstFolder folder;
+    Compiler compiler;
+};
+
+Pipeline::Pipeline(TypeChecker &checker, Compiler &compiler, unsigned num_threads)
+    : checker_(checker), compiler_(compiler), pool_(num_threads) {
+}
+
+Pipeline::~Pipeline() = default;
+
+// Syntax errors are reported as soon as they are found, and semantic errors
+// outside of the functions let the parser finish first. Those in functions
+// wait for the end of the parse, then the one of the first function in
+// source order is reported, as with the passes one after the other.
+Ptr<ProgramNode> Pipeline::Run(Parser &parser, const std::string &filename) {
+    checker_.SetParser(&parser);
+    Ptr<ProgramNode> program = parser.ParseFile(filename, this);
+    checker_.SetParser(nullptr);
+
+    pool_.Wait();
+    if (first_failed_ != kNoFunction)
+        checker_.ReportError(failed_worker_->checker);
+    return program;
+}
+
+void Pipeline::Assemble(ProgramNode *program) {
+    compiler_.AddStartFunc();
+    compiler_.GenStartFunc(program);
+    compiler_.GenerateCode();
+}
+
+void Pipeline::OnSignatures(const std::shared_ptr<SourceBuffer> &source,
+                            Span<FuncDefNode *> functions) {
+    checker_.DeclareFunctions(source, functions);
+    signatures_ = functions;
+}
+
+void Pipeline::OnGlobalVar(DeclStmtNode *var) {
+    checker_.Walk(var);
+    if (fold_)
+        folder_.FoldGlobal(var);
+    compiler_.AllocateGlobal(var);
+}
+
+// The global variables come first, so by the first function the global
+// scope and slots are complete and stay as they are while workers read them.
+// All functions get their FuncDef then, for the calls of functions that are
+// not parsed yet.
+void Pipeline::OnFuncDef(FuncDefNode *func) {
+    if (num_funcs_ == 0)
+        compiler_.DeclareFunctions(signatures_);
+
+    const size_t index = num_funcs_++;
+    pool_.Submit([this, func, index] {
+        // An error after the first one is never reported.
+        if (index > first_failed_)
+            return;
+
+        std::unique_ptr<Worker> worker = TakeWorker();
+        if (!worker->checker.CheckFunction(func)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (index < first_failed_) {
+                first_failed_ = index;
+                failed_worker_ = std::move(worker);
+            }
+            return;
+        }
+        if (fold_)
+            worker->folder.FoldFunction(func);
+        worker->compiler.GenFunction(func);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_workers_.push_back(std::move(worker));
+    });
+}
+
+// Let the workers finish before the process exits under them.
+void Pipeline::OnSyntaxError() {
+    pool_.Wait();
+}
+
+std::unique_ptr<Pipeline::Worker> Pipeline::TakeWorker() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_workers_.empty())
+        return std::make_unique<Worker>(checker_, compiler_);
+
+    std::unique_ptr<Worker> worker = std::move(idle_workers_.back());
+    idle_workers_.pop_back();
+    return worker;
+}
@@ -0,0 +1,64 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "analyzer.h"
+#include "compiler.h"
+#include "const_folder.h"
+#include "thread_pool.h"
+
+// Compiles a file with the passes overlapped: each function is checked and
+// generated on a thread pool as soon as it is parsed, while the parser goes
+// on with the next one. The output is the same as from the passes one after
+// the other, errors included.
+class Pipeline final : public ParseListener {
+public:
+    Pipeline(TypeChecker &checker, Compiler &compiler, unsigned num_threads = DefaultThreadCount());
+    ~Pipeline();
+
+    // Fold the constants of each part of the program after checking it,
+    // leaving calls to run time, see ConstFolder::FoldFunction().
+    void SetFolding(bool fold) { fold_ = fold; }
+
+    // Parse the file and check and generate all of its functions. The
+    // parser must be in an eager scan mode, so that no names are interned
+    // while the workers run. Exits on the first error.
+    Ptr<ProgramNode> Run(Parser &parser, const std::string &filename);
+
+    // Write the program returned by Run() to the output of the compiler.
+    void Assemble(ProgramNode *program);
+
+    void OnSignatures(const std::shared_ptr<SourceBuffer> &source,
+                      Span<FuncDefNode *> functions) override;
+    void OnGlobalVar(DeclStmtNode *var) override;
+    void OnFuncDef(FuncDefNode *func) override;
+    void OnSyntaxError() override;
+
+private:
+    struct Worker;
+
+    std::unique_ptr<Worker> TakeWorker();
+
+private:
+    static constexpr size_t kNoFunction = ~size_t(0);
+
+    TypeChecker &checker_;
+    Compiler &compiler_;
+    ThreadPool pool_;
+    ConstFolder folder_;                    // For the global variables.
+    bool fold_ = false;
+    Span<FuncDefNode *> signatures_;
+    size_t num_funcs_ = 0;                  // Parsed so far.
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Worker>> idle_workers_;
+    std::atomic<size_t> first_failed_{kNoFunction};
+    std::unique_ptr<Worker> failed_worker_; // That of first_failed_.
+};
+
+#endif // PIPELINE_H_
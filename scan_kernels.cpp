@@ -0,0 +1,180 @@
+#include "scan_kernels.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define SCAN_KERNELS_X86 1
+#endif
+
+static size_t ScalarSpanSpace(const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && IsSpaceChar(p[i]))
+        ++i;
+    return i;
+}
+
+static size_t ScalarSpanDigit(const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && IsDigitChar(p[i]))
+        ++i;
+    return i;
+}
+
+static size_t ScalarSpanIdent(const char *p, size_t n) {
+    size_t i = 0;
+    while (i < n && IsIdentChar(p[i]))
+        ++i;
+    return i;
+}
+
+static const ScanKernels SCALAR_KERNELS {
+    "scalar",
+    ScalarSpanSpace,
+    ScalarSpanDigit,
+    ScalarSpanIdent,
+};
+
+#ifdef SCAN_KERNELS_X86
+
+// The byte compares are signed, so bytes >= 0x80 never fall into any class.
+
+static __m128i Sse2InRange(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static __m128i Sse2Space(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), Sse2InRange(v, '\t', '\r'));
+}
+
+static __m128i Sse2Digit(__m128i v) {
+    return Sse2InRange(v, '0', '9');
+}
+
+static __m128i Sse2Ident(__m128i v) {
+    // Setting bit 5 maps 'A'-'Z' onto 'a'-'z' and nothing else onto it.
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i m = _mm_or_si128(Sse2InRange(lower, 'a', 'z'), Sse2InRange(v, '0', '9'));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+template <__m128i (*Match)(__m128i), bool (*IsChar)(char)>
+static size_t Sse2Span(const char *p, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        unsigned mask = ~_mm_movemask_epi8(Match(v)) & 0xffffu;
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    while (i < n && IsChar(p[i]))
+        ++i;
+    return i;
+}
+
+static size_t Sse2SpanSpace(const char *p, size_t n) {
+    return Sse2Span<Sse2Space, IsSpaceChar>(p, n);
+}
+
+static size_t Sse2SpanDigit(const char *p, size_t n) {
+    return Sse2Span<Sse2Digit, IsDigitChar>(p, n);
+}
+
+static size_t Sse2SpanIdent(const char *p, size_t n) {
+    return Sse2Span<Sse2Ident, IsIdentChar>(p, n);
+}
+
+static const ScanKernels SSE2_KERNELS {
+    "sse2",
+    Sse2SpanSpace,
+    Sse2SpanDigit,
+    Sse2SpanIdent,
+};
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET static __m256i Avx2InRange(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+AVX2_TARGET static __m256i Avx2Space(__m256i v) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), Avx2InRange(v, '\t', '\r'));
+}
+
+AVX2_TARGET static __m256i Avx2Digit(__m256i v) {
+    return Avx2InRange(v, '0', '9');
+}
+
+AVX2_TARGET static __m256i Avx2Ident(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i m = _mm256_or_si256(Avx2InRange(lower, 'a', 'z'), Avx2InRange(v, '0', '9'));
+    return _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+// Whole 32 byte blocks first, the rest is left to the SSE2 kernel. The upper
+// halves of the registers are cleared before that, mixing dirty AVX state
+// with legacy SSE code is very slow on some CPUs.
+template <__m256i (*Match)(__m256i), size_t (*Fallback)(const char *, size_t)>
+AVX2_TARGET static size_t Avx2Span(const char *p, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(Match(v)));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    _mm256_zeroupper();
+    return i + Fallback(p + i, n - i);
+}
+
+AVX2_TARGET static size_t Avx2SpanSpace(const char *p, size_t n) {
+    return Avx2Span<Avx2Space, Sse2SpanSpace>(p, n);
+}
+
+AVX2_TARGET static size_t Avx2SpanDigit(const char *p, size_t n) {
+    return Avx2Span<Avx2Digit, Sse2SpanDigit>(p, n);
+}
+
+AVX2_TARGET static size_t Avx2SpanIdent(const char *p, size_t n) {
+    return Avx2Span<Avx2Ident, Sse2SpanIdent>(p, n);
+}
+
+static const ScanKernels AVX2_KERNELS {
+    "avx2",
+    Avx2SpanSpace,
+    Avx2SpanDigit,
+    Avx2SpanIdent,
+};
+
+#endif // SCAN_KERNELS_X86
+
+const ScanKernels *GetScanKernels(ScanKernelKind kind) {
+    switch (kind) {
+    case kScanKernelScalar:
+        return &SCALAR_KERNELS;
+#ifdef SCAN_KERNELS_X86
+    case kScanKernelSse2:
+        return &SSE2_KERNELS;
+    case kScanKernelAvx2:
+        if (__builtin_cpu_supports("avx2"))
+            return &AVX2_KERNELS;
+        return nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+const ScanKernels &BestScanKernels() {
+    static const ScanKernels *best = [] {
+        const ScanKernels *kernels = GetScanKernels(kScanKernelAvx2);
+        if (kernels == nullptr)
+            kernels = GetScanKernels(kScanKernelSse2);
+        if (kernels == nullptr)
+            kernels = &SCALAR_KERNELS;
+        return kernels;
+    }();
+    return *best;
+}
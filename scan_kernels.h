@@ -0,0 +1,44 @@
+#ifndef SCAN_KERNELS_H_
+#define SCAN_KERNELS_H_
+
+#include <cstddef>
+
+// Character class kernels used by the scanner. Each function returns the
+// length of the longest prefix of [p, p + n) whose characters all belong to
+// the class. The classes follow the "C" locale:
+//   space: ' ', '\t', '\n', '\v', '\f', '\r'
+//   digit: '0'-'9'
+//   ident: 'a'-'z', 'A'-'Z', '0'-'9', '_'
+struct ScanKernels {
+    const char *name;
+    size_t (*span_space)(const char *p, size_t n);
+    size_t (*span_digit)(const char *p, size_t n);
+    size_t (*span_ident)(const char *p, size_t n);
+};
+
+// The classes one character at a time, for the scanner's single checks.
+inline bool IsSpaceChar(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool IsDigitChar(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool IsIdentChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || IsDigitChar(c) || c == '_';
+}
+
+enum ScanKernelKind {
+    kScanKernelScalar,
+    kScanKernelSse2,
+    kScanKernelAvx2,
+};
+
+// The kernels of the given kind, or nullptr if the CPU does not support them.
+const ScanKernels *GetScanKernels(ScanKernelKind kind);
+
+// The fastest kernels supported by the CPU.
+const ScanKernels &BestScanKernels();
+
+#endif // SCAN_KERNELS_H_
@@ -1,115 +1,463 @@
 #include "scanner.h"
 
+#include <algorithm>
+#include <charconv>
 #include <cstdlib>
 #include <cctype>
+#include <cstring>
 #include <utility>
 #include <iostream>
-#include <map>
-#include <unordered_map>
-
-static const std::map<std::string, TokenType> KEYWORDS{
-    {"fn", kFn},
-    {"let", kLet},
-    {"const", kConst},
-    {"as", kAs},
-    {"while", kWhile},
-    {"if", kIf},
-    {"else", kElse},
-    {"return", kReturn},
-};
 
-static const std::map<TokenType, std::string> TOKEN_NAMES {
-    {kFn, "Fn"},
-    {kLet, "Let"},
-    {kConst, "Const"},
-    {kAs, "As"},
-    {kWhile, "While"},
-    {kIf, "If"},
-    {kElse, "Else"},
-    {kReturn, "Return"},
-    {kBreak, "Break"},
-    {kContinue, "Continue"},
-    {kIdent, "Ident"},
-    {kPlus, "+"},
-    {kMinus, "-"},
-    {kMul, "*"},
-    {kDiv, "/"},
-    {kAssign, "="},
-    {kEq, "=="},
-    {kNeq, "!="},
-    {kLt, "<"},
-    {kGt, ">"},
-    {kLe, "<="},
-    {kGe, ">="},
-    {kL_paren, "("},
-    {kR_paren, ")"},
-    {kL_brace, "{"},
-    {kR_brace, "}"},
-    {kArrow, "->"},
-    {kComma, ","},
-    {kColon, ":"},
-    {kSemicolon, ";"},
-    {kIntLiteral, "IntLiteral"},
-    {kDoubleLiteral, "DoubleLiteral"},
-    {kEof,  "Eof"},
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Indexed by TokenType.
+static constexpr const char *TOKEN_NAMES[] {
+    "Fn",
+    "Let",
+    "Const",
+    "As",
+    "While",
+    "If",
+    "Else",
+    "Return",
+    "Break",
+    "Continue",
+    "Ident",
+    "+",
+    "-",
+    "*",
+    "/",
+    "=",
+    "==",
+    "!=",
+    "<",
+    ">",
+    "<=",
+    ">=",
+    "(",
+    ")",
+    "{",
+    "}",
+    "->",
+    ",",
+    ":",
+    ";",
+    "IntLiteral",
+    "DoubleLiteral",
+    "Eof",
 };
 
-const std::string &TokenToString(TokenType type) {
-    return TOKEN_NAMES.at(type);
+static_assert(sizeof(TOKEN_NAMES) / sizeof(TOKEN_NAMES[0]) == kEof + 1,
+              "TOKEN_NAMES must have an entry for every TokenType");
+
+const char *TokenToString(TokenType type) {
+    return TOKEN_NAMES[type];
+}
+
+// Returns the keyword spelled by s, or kIdent. No two keywords share both
+// their length and their first character, so this is a single compare.
+static constexpr TokenType KeywordType(std::string_view s) {
+    switch (s.size()) {
+    case 2:
+        switch (s[0]) {
+        case 'a':
+            return s == "as" ? kAs : kIdent;
+        case 'f':
+            return s == "fn" ? kFn : kIdent;
+        case 'i':
+            return s == "if" ? kIf : kIdent;
+        }
+        break;
+    case 3:
+        return s == "let" ? kLet : kIdent;
+    case 4:
+        return s == "else" ? kElse : kIdent;
+    case 5:
+        switch (s[0]) {
+        case 'b':
+            return s == "break" ? kBreak : kIdent;
+        case 'c':
+            return s == "const" ? kConst : kIdent;
+        case 'w':
+            return s == "while" ? kWhile : kIdent;
+        }
+        break;
+    case 6:
+        return s == "return" ? kReturn : kIdent;
+    case 8:
+        return s == "continue" ? kContinue : kIdent;
+    }
+    return kIdent;
 }
 
+static_assert(KeywordType("fn") == kFn && KeywordType("let") == kLet &&
+              KeywordType("const") == kConst && KeywordType("as") == kAs &&
+              KeywordType("while") == kWhile && KeywordType("if") == kIf &&
+              KeywordType("else") == kElse && KeywordType("return") == kReturn &&
+              KeywordType("break") == kBreak && KeywordType("continue") == kContinue,
+              "every keyword must be recognized");
+static_assert(KeywordType("fnx") == kIdent && KeywordType("cons") == kIdent &&
+              KeywordType("bre") == kIdent && KeywordType("while_") == kIdent,
+              "identifiers must not be taken for keywords");
+
 // Remove trailing spaces from the given string.
-static void RTrim(std::string &s) {
-    if (s.empty())
-        return;
+static void RTrim(std::string_view &s) {
+    while (!s.empty() && IsSpaceChar(s.back()))
+        s.remove_suffix(1);
+}
+
+static bool IsLetter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
 
-    for (int i = s.size() - 1; i >= 0; --i) {
-        if (!isspace(s[i]))
+std::shared_ptr<SourceBuffer> SourceBuffer::Open(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    auto buffer = std::make_shared<SourceBuffer>();
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            return buffer;
+        }
+
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            buffer->data_ = static_cast<const char *>(p);
+            buffer->size_ = st.st_size;
+            buffer->mapped_ = true;
+            close(fd);
+            return buffer;
+        }
+    }
+
+    // Not mappable (pipe, device, ...): read everything into memory.
+    char chunk[64 * 1024];
+    while (true) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0) {
+            close(fd);
+            return nullptr;
+        }
+        if (n == 0)
             break;
-        s.pop_back();
+        buffer->storage_.append(chunk, n);
     }
+    close(fd);
+
+    buffer->data_ = buffer->storage_.data();
+    buffer->size_ = buffer->storage_.size();
+    return buffer;
 }
 
-static bool IsLetter(char c) {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+std::shared_ptr<SourceBuffer> SourceBuffer::FromString(std::string text) {
+    auto buffer = std::make_shared<SourceBuffer>();
+    buffer->storage_ = std::move(text);
+    buffer->data_ = buffer->storage_.data();
+    buffer->size_ = buffer->storage_.size();
+    return buffer;
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (mapped_)
+        munmap(const_cast<char *>(data_), size_);
+}
+
+void SourceBuffer::IndexLines() const {
+    line_starts_.push_back(0);
+
+    const char *p = data_;
+    const char *end = data_ + size_;
+    while ((p = static_cast<const char *>(memchr(p, '\n', end - p))) != nullptr) {
+        ++p;
+        line_starts_.push_back(p - data_);
+    }
+}
+
+uint32_t SourceBuffer::LineNo(Position pos) const {
+    if (pos.offset == Position::kNone)
+        return 0;
+    if (line_starts_.empty())
+        IndexLines();
+
+    auto it = std::upper_bound(line_starts_.begin(), line_starts_.end(), pos.offset);
+    return it - line_starts_.begin();
+}
+
+uint32_t SourceBuffer::ColNo(Position pos) const {
+    if (pos.offset == Position::kNone)
+        return 0;
+    return pos.offset - line_starts_[LineNo(pos) - 1] + 1;
+}
+
+void TokenStore::Push(const Token &tk) {
+    types_.push_back(tk.type);
+    offsets_.push_back(tk.pos.offset);
+    lengths_.push_back(tk.lexeme.size());
+
+    if (tk.type == kIntLiteral || tk.type == kDoubleLiteral) {
+        aux_.push_back(literals_.size());
+        literals_.push_back(static_cast<uint64_t>(tk.int_value));
+    } else {
+        aux_.push_back(tk.sym);
+    }
+}
+
+Token TokenStore::At(size_t i, std::string_view text) const {
+    Token tk;
+    tk.type = static_cast<TokenType>(types_[i]);
+    tk.pos.offset = offsets_[i];
+    tk.lexeme = text.substr(offsets_[i], lengths_[i]);
+
+    if (tk.type == kIntLiteral || tk.type == kDoubleLiteral) {
+        tk.int_value = static_cast<int64_t>(literals_[aux_[i]]);
+    } else {
+        tk.sym = aux_[i];
+    }
+    return tk;
+}
+
+void TokenStore::Resize(size_t num_tokens, size_t num_literals) {
+    types_.resize(num_tokens);
+    offsets_.resize(num_tokens);
+    lengths_.resize(num_tokens);
+    aux_.resize(num_tokens);
+    literals_.resize(num_literals);
+}
+
+void TokenStore::CopyFrom(const TokenStore &src, size_t first, size_t first_literal,
+                          const std::vector<Symbol> &symbols) {
+    std::copy(src.types_.begin(), src.types_.end(), types_.begin() + first);
+    std::copy(src.offsets_.begin(), src.offsets_.end(), offsets_.begin() + first);
+    std::copy(src.lengths_.begin(), src.lengths_.end(), lengths_.begin() + first);
+    std::copy(src.literals_.begin(), src.literals_.end(), literals_.begin() + first_literal);
+
+    for (size_t i = 0; i < src.Size(); ++i) {
+        uint32_t aux = src.aux_[i];
+        if (src.types_[i] == kIdent) {
+            aux = symbols[aux];
+        } else if (src.types_[i] == kIntLiteral || src.types_[i] == kDoubleLiteral) {
+            aux += first_literal;
+        }
+        aux_[first + i] = aux;
+    }
+}
+
+std::vector<uint32_t> FindTopLevelFns(std::string_view text) {
+    std::vector<uint32_t> offsets;
+    int depth = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        const char c = text[i];
+        if (c == '{') {
+            ++depth;
+        } else if (c == '}') {
+            --depth;
+        } else if (c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+            i = text.find('\n', i);
+            if (i == std::string_view::npos)
+                break;
+        } else if (IsIdentChar(c)) {
+            const size_t start = i;
+            while (i < text.size() && IsIdentChar(text[i]))
+                ++i;
+            if (depth == 0 && text.substr(start, i - start) == "fn")
+                offsets.push_back(start);
+            continue;
+        }
+        ++i;
+    }
+    return offsets;
 }
 
 void Scanner::ScanFile(const std::string &filename) {
     filename_ = filename;
-    input_.open(filename);
+    source_ = SourceBuffer::Open(filename);
 
-    if (!input_.is_open()) {
+    if (!source_) {
         error_ << "Cannot open the file " << filename;
         Error();
     }
 
-    ScanAllTokens();
-    input_.close();
+    text_ = source_->Text();
+    if (text_.size() >= Position::kNone) {
+        error_ << "The file " << filename << " is too large";
+        Error();
+    }
+
+    end_ = text_.size();
+    if (mode_ == kScanEager)
+        ScanAllTokens();
+    else if (mode_ == kScanParallel)
+        ScanAllTokensParallel();
+}
+
+void Scanner::LoadTokens(const std::string &filename, std::shared_ptr<SourceBuffer> source,
+                         TokenStore tokens) {
+    mode_ = kScanEager;
+    filename_ = filename;
+    source_ = std::move(source);
+    text_ = source_->Text();
+    end_ = text_.size();
+    tokens_ = std::move(tokens);
+    store_ = &tokens_;
+    index_ = 0;
+    token_end_ = kNoTokenEnd;
+}
+
+void Scanner::ScanSource(std::shared_ptr<SourceBuffer> source, size_t offset) {
+    mode_ = kScanStreaming;
+    source_ = std::move(source);
+    text_ = source_->Text();
+    next_line_ = offset;
+    end_ = text_.size();
+    line_ = {};
+    col_ = 0;
+    ring_head_ = 0;
+    ring_count_ = 0;
+    exit_on_error_ = false;
+    failed_ = false;
 }
 
-const Token &Scanner::GetToken() {
-    if (index_ < tokens_.size()) {
-        return tokens_[index_++];
+void Scanner::ShareTokens(const Scanner &other, size_t first, size_t last) {
+    mode_ = kScanEager;
+    filename_ = other.filename_;
+    source_ = other.source_;
+    text_ = other.text_;
+    store_ = other.store_;
+    index_ = first;
+    token_end_ = last;
+}
+
+std::vector<size_t> Scanner::FindTopLevelFnTokens(size_t first) const {
+    std::vector<size_t> indices;
+    int depth = 0;
+    for (size_t i = first; i < store_->Size(); ++i) {
+        switch (store_->Type(i)) {
+        case kL_brace:
+            ++depth;
+            break;
+        case kR_brace:
+            --depth;
+            break;
+        case kFn:
+            if (depth == 0)
+                indices.push_back(i);
+            break;
+        default:
+            break;
+        }
+    }
+    return indices;
+}
+
+bool Scanner::ScanLine(std::string_view line, std::vector<Token> &tokens,
+                       std::string &error, int &error_col) {
+    text_ = line;
+    next_line_ = 0;
+    end_ = line.size();
+    line_ = {};
+    line_no_ = 0;
+    col_ = 0;
+    exit_on_error_ = false;
+    failed_ = false;
+
+    Token tk;
+    while (NextToken(tk)) {
+        tokens.push_back(tk);
+    }
+
+    if (failed_) {
+        error = error_message_;
+        error_col = error_col_;
+        return false;
+    }
+    return true;
+}
+
+Token Scanner::GetToken() {
+    if (mode_ == kScanStreaming) {
+        if (!FillLookahead(1))
+            return eop_;
+
+        const Token &tk = ring_[ring_head_];
+        ring_head_ = (ring_head_ + 1) % kLookahead;
+        --ring_count_;
+        return tk;
+    }
+
+    if (index_ < NumTokens()) {
+        return store_->At(index_++, text_);
     } else {
         return eop_;
     }
 }
 
-const Token &Scanner::Peek(int i) const {
-    if (index_ + i < tokens_.size())
-        return tokens_[index_ + i];
+Token Scanner::Peek(int i) {
+    if (mode_ == kScanStreaming) {
+        if (!FillLookahead(i + 1))
+            return eop_;
+        return ring_[(ring_head_ + i) % kLookahead];
+    }
+
+    if (index_ + i < NumTokens())
+        return store_->At(index_ + i, text_);
     return eop_;
 }
 
+// Make sure at least n tokens are buffered, returns false if the file ends
+// before that.
+bool Scanner::FillLookahead(int n) {
+    while (ring_count_ < n) {
+        Token &tk = ring_[(ring_head_ + ring_count_) % kLookahead];
+        if (!NextToken(tk))
+            return false;
+        ++ring_count_;
+    }
+    return true;
+}
+
+// Move to the next line of the file, returns false at the end of file.
+bool Scanner::NextLine() {
+    if (next_line_ >= end_)
+        return false;
+
+    size_t line_end = text_.find('\n', next_line_);
+    if (line_end == std::string_view::npos)
+        line_end = text_.size();
+
+    line_ = text_.substr(next_line_, line_end - next_line_);
+    line_offset_ = next_line_;
+    next_line_ = line_end + 1;
+    RTrim(line_);
+    ++line_no_;
+    col_ = 0;
+    return true;
+}
+
+bool Scanner::NextToken(Token &tk) {
+    while (!ScanToken(tk)) {
+        if (!NextLine())
+            return false;
+    }
+    return !failed_;
+}
+
 bool Scanner::ScanToken(Token &tk) {
     SkipSpaceOrComment();
     if (col_ >= line_.size())
         return false;
 
-    tk.lexeme = "";
+    tk.lexeme = {};
     tk.type = kEof;
-    tk.pos.SetLineNo(line_no_);
-    tk.pos.SetColNo(col_ + 1);
+    tk.sym = kNoSymbol;
+    tk.pos.offset = line_offset_ + col_;
 
     int token_len = 1;
 
@@ -187,7 +535,7 @@ bool Scanner::ScanToken(Token &tk) {
         break;
     default:
         token_len = 0;
-        if (isdigit(line_[col_])) {
+        if (IsDigitChar(line_[col_])) {
             ScanDoubleOrInt(tk);
         } else if (IsLetter(line_[col_]) || line_[col_] == '_') {
             ScanIDOrKeyword(tk);
@@ -204,37 +552,34 @@ bool Scanner::ScanToken(Token &tk) {
 
 void Scanner::ScanDoubleOrInt(Token &tk) {
     const int tk_start = col_;
-    while (col_ < line_.size() && isdigit(line_[col_]))
-        ++col_;
+    SkipDigits();
 
     if (col_ < line_.size() && line_[col_] == '.') {
         ++col_;
-        if (col_ >= line_.size() || !isdigit(line_[col_])) {
+        if (col_ >= line_.size() || !IsDigitChar(line_[col_])) {
             error_ << "Expected digit";
             Error();
         }
 
-        while (col_ < line_.size() && isdigit(line_[col_]))
-            ++col_;
+        SkipDigits();
 
         // Parse the exponent
-        if (col_ < line_.size() && line_[col_] == 'e' || line_[col_] == 'E') {
+        if (col_ < line_.size() && (line_[col_] == 'e' || line_[col_] == 'E')) {
             ++col_;
             if (col_ >= line_.size()) {
                 error_ << "Unexpected end of line";
                 Error();
             }
 
-            if (line_[col_] == '+' || line_[col_] == '-')
+            if (col_ < line_.size() && (line_[col_] == '+' || line_[col_] == '-'))
                 ++col_;
 
-            if (col_ >= line_.size() || !isdigit(line_[col_])) {
+            if (col_ >= line_.size() || !IsDigitChar(line_[col_])) {
                 error_ << "Expected digit";
                 Error();
             }
 
-            while (col_ < line_.size() && isdigit(line_[col_]))
-                ++col_;
+            SkipDigits();
         }
 
         tk.type = kDoubleLiteral;
@@ -243,43 +588,132 @@ void Scanner::ScanDoubleOrInt(Token &tk) {
     }
 
     tk.lexeme = line_.substr(tk_start, col_ - tk_start);
+
+    // The lexeme is known to be well formed here, so the only possible
+    // failure is a value that does not fit.
+    const char *first = tk.lexeme.data();
+    const char *last = first + tk.lexeme.size();
+    std::from_chars_result res;
+    if (tk.type == kIntLiteral) {
+        res = std::from_chars(first, last, tk.int_value);
+    } else {
+        res = std::from_chars(first, last, tk.double_value);
+    }
+
+    if (res.ec != std::errc()) {
+        col_ = tk_start;
+        error_ << "Literal " << tk.lexeme << " is out of range";
+        Error();
+    }
 }
 
 void Scanner::ScanIDOrKeyword(Token &tk) {
     const int start = col_;
-    while (col_ < line_.size() && (IsLetter(line_[col_]) || isdigit(line_[col_]) || line_[col_] == '_'))
-        ++col_;
+    col_ += kernels_->span_ident(line_.data() + col_, line_.size() - col_);
 
     tk.lexeme = line_.substr(start, col_ - start);
 
-    auto it = KEYWORDS.find(tk.lexeme);
-    if (it != KEYWORDS.end()) {
-        tk.type = it->second;
-    } else {
-        tk.type = kIdent;
-    }
+    tk.type = KeywordType(tk.lexeme);
+    if (tk.type == kIdent)
+        tk.sym = interner_->Intern(tk.lexeme);
 }
 
 void Scanner::ScanAllTokens() {
-    while (std::getline(input_, line_)) {
-        RTrim(line_);
-        ++line_no_;
-
-        if (line_.empty())
-            continue;   // Skip empty line.
+    Token tk;
+    while (NextToken(tk)) {
+        tokens_.Push(tk);
+    }
+}
 
-        Token tk;
-        col_ = 0;
+// Any newline is a safe place to split a C0 file, there are no block
+// comments or multi-line literals. Each chunk is scanned by its own Scanner
+// with a private interner, then the chunks are joined in source order. The
+// result, symbol ids included, is the same as that of ScanAllTokens().
+void Scanner::ScanAllTokensParallel() {
+    constexpr size_t kMinChunkSize = 256 * 1024;
+
+    size_t num_chunks = std::min<size_t>(num_threads_, text_.size() / kMinChunkSize);
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < num_chunks; ++i) {
+        size_t nl = text_.find('\n', std::max(bounds.back(), text_.size() / num_chunks * i));
+        if (nl == std::string_view::npos)
+            break;
+        bounds.push_back(nl + 1);
+    }
+    bounds.push_back(text_.size());
+    num_chunks = bounds.size() - 1;
+
+    std::vector<std::unique_ptr<Scanner>> chunks;
+    std::vector<std::unique_ptr<Interner>> interners;
+    for (size_t i = 0; i < num_chunks; ++i) {
+        auto chunk = std::make_unique<Scanner>(kScanEager);
+        interners.push_back(std::make_unique<Interner>());
+        chunk->kernels_ = kernels_;
+        chunk->interner_ = interners.back().get();
+        chunk->text_ = text_;
+        chunk->next_line_ = bounds[i];
+        chunk->end_ = bounds[i + 1];
+        chunk->exit_on_error_ = false;
+        chunks.push_back(std::move(chunk));
+    }
 
-        while (ScanToken(tk)) {
-            tokens_.push_back(std::move(tk));
+    ThreadPool pool(std::min<size_t>(num_threads_, num_chunks));
+    for (auto &chunk : chunks) {
+        Scanner *s = chunk.get();
+        pool.Submit([s] { s->ScanAllTokens(); });
+    }
+    pool.Wait();
+
+    // Report the first error in source order. Line numbers in a chunk start
+    // at 1, the earlier chunks were scanned completely.
+    for (const auto &chunk : chunks) {
+        if (chunk->failed_) {
+            line_no_ += chunk->error_line_no_;
+            col_ = chunk->error_col_;
+            error_ << chunk->error_message_;
+            Error();
         }
+        line_no_ += chunk->line_no_;
+    }
+
+    // Intern the names chunk by chunk so symbols get the same ids as in a
+    // serial scan.
+    std::vector<std::vector<Symbol>> symbols(num_chunks);
+    for (size_t i = 0; i < num_chunks; ++i) {
+        const Interner &local = *interners[i];
+        symbols[i].resize(local.Size());
+        for (Symbol sym = 0; sym < local.Size(); ++sym)
+            symbols[i][sym] = interner_->Intern(local.Name(sym));
+    }
+
+    size_t num_tokens = 0;
+    size_t num_literals = 0;
+    for (const auto &chunk : chunks) {
+        num_tokens += chunk->tokens_.Size();
+        num_literals += chunk->tokens_.NumLiterals();
+    }
+    tokens_.Resize(num_tokens, num_literals);
+
+    size_t first = 0;
+    size_t first_literal = 0;
+    for (size_t i = 0; i < num_chunks; ++i) {
+        const TokenStore &src = chunks[i]->tokens_;
+        const std::vector<Symbol> &chunk_symbols = symbols[i];
+        pool.Submit([this, &src, first, first_literal, &chunk_symbols] {
+            tokens_.CopyFrom(src, first, first_literal, chunk_symbols);
+        });
+        first += src.Size();
+        first_literal += src.NumLiterals();
     }
+    pool.Wait();
+}
+
+void Scanner::SkipDigits() {
+    col_ += kernels_->span_digit(line_.data() + col_, line_.size() - col_);
 }
 
 void Scanner::SkipSpaceOrComment() {
-    while (col_ < line_.size() && isspace(line_[col_]))
-        ++col_;
+    col_ += kernels_->span_space(line_.data() + col_, line_.size() - col_);
 
     // Skip comment.
     if (col_ + 1 < line_.size() && line_[col_] == '/' && line_[col_ + 1] == '/')
@@ -287,6 +721,19 @@ void Scanner::SkipSpaceOrComment() {
 }
 
 void Scanner::Error() {
+    if (!exit_on_error_) {
+        // Keep the first error for the caller, scanning stops after the
+        // current token.
+        if (!failed_) {
+            failed_ = true;
+            error_line_no_ = line_no_;
+            error_col_ = col_;
+            error_message_ = error_.str();
+        }
+        error_.str("");
+        return;
+    }
+
     std::cout << filename_ << ":"
               << line_no_ << ":"
               << col_ + 1 << ": lexical error: "
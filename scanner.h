@@ -1,12 +1,18 @@
 #ifndef SCANNER_H_
 #define SCANNER_H_
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <fstream>
+#include <memory>
 #include <cstdint>
 #include <sstream>
 
+#include "interner.h"
+#include "scan_kernels.h"
+#include "thread_pool.h"
+
 enum TokenType {
     // Begin of keywords
     kFn,
@@ -47,48 +53,198 @@ enum TokenType {
     kEof,        // End of file.
 };
 
-const std::string &TokenToString(TokenType type);
+const char *TokenToString(TokenType type);
 
+// Byte offset into the source file. Line and column are only worked out
+// when needed, see SourceBuffer::LineNo() and SourceBuffer::ColNo().
 struct Position {
-    uint64_t pos = 0;
+    static constexpr uint32_t kNone = 0xffffffffu;
 
-    uint32_t LineNo() const { return pos >> 32u; }
-    uint32_t ColNo() const { return pos & 0xffffffffull; }
-    void SetLineNo(uint32_t line_no) { pos = (pos & 0xffffffffull) | (static_cast<uint64_t>(line_no) << 32u); }
-    void SetColNo(uint32_t col) { pos = (pos & 0xffffffff00000000ull) | col; }
+    uint32_t offset = kNone;    // kNone is reported as line 0, column 0.
 };
 
 struct Token {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;    // Points into the SourceBuffer of the file.
     Position pos;
+    Symbol sym = kNoSymbol;     // Set for identifiers.
+
+    // The decoded value of an int or double literal.
+    union {
+        int64_t int_value = 0;
+        double double_value;
+    };
+};
+
+// The whole content of a source file. Regular files are memory-mapped, other
+// inputs (pipes, character devices) are read into an owned buffer. Tokens and
+// AST nodes keep views into the text, so the buffer must outlive them.
+class SourceBuffer {
+public:
+    static std::shared_ptr<SourceBuffer> Open(const std::string &filename);
+    static std::shared_ptr<SourceBuffer> FromString(std::string text);
+
+    SourceBuffer() = default;
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+    ~SourceBuffer();
+
+    std::string_view Text() const { return {data_, size_}; }
+
+    // 1-based line and column of a position. The line index is built on
+    // the first call.
+    uint32_t LineNo(Position pos) const;
+    uint32_t ColNo(Position pos) const;
+
+private:
+    void IndexLines() const;
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::string storage_;
+
+    mutable std::vector<uint32_t> line_starts_;
+};
+
+// The tokens of a whole file in structure-of-arrays form, 13 bytes per
+// token plus 8 per literal. Lexemes are recovered from the source text.
+class TokenStore {
+public:
+    void Push(const Token &tk);
+    Token At(size_t i, std::string_view text) const;
+    TokenType Type(size_t i) const { return static_cast<TokenType>(types_[i]); }
+    size_t Size() const { return types_.size(); }
+    size_t NumLiterals() const { return literals_.size(); }
+
+    // Make room for tokens and literals filled in by CopyFrom().
+    void Resize(size_t num_tokens, size_t num_literals);
+
+    // Copy all of src to token index `first` and literal index
+    // `first_literal`, mapping identifier symbols through `symbols`.
+    // Copies into disjoint ranges may run concurrently.
+    void CopyFrom(const TokenStore &src, size_t first, size_t first_literal,
+                  const std::vector<Symbol> &symbols);
+
+private:
+    std::vector<uint8_t> types_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    std::vector<uint32_t> aux_;         // Symbol, or index into literals_.
+    std::vector<uint64_t> literals_;
+};
+
+// Offsets of the `fn` keywords outside of braces, found by a quick pass
+// that only knows about comments, braces and words. It can only be wrong
+// for text that does not parse.
+std::vector<uint32_t> FindTopLevelFns(std::string_view text);
+
+enum ScanMode {
+    kScanStreaming,     // Lex on demand into a small lookahead ring.
+    kScanEager,         // Lex the whole file up front.
+    kScanParallel,      // Like kScanEager, lexing newline-aligned chunks on a thread pool.
 };
 
 class Scanner {
 public:
+    // Number of tokens the streaming mode keeps around. Peek(i) requires
+    // i < kLookahead.
+    static constexpr int kLookahead = 4;
+    static constexpr size_t kNoTokenEnd = ~size_t(0);
+
+    explicit Scanner(ScanMode mode = kScanStreaming) : mode_(mode), kernels_(&BestScanKernels()) {}
+
+    // Override the character class kernels picked for this CPU.
+    void SetKernels(const ScanKernels &kernels) { kernels_ = &kernels; }
+
+    // Number of threads used by kScanParallel.
+    void SetThreads(unsigned num_threads) { num_threads_ = num_threads; }
+
+    ScanMode Mode() const { return mode_; }
+
     void ScanFile(const std::string &filename);
-    const Token &GetToken();
-    const Token &Peek(int i) const;
+
+    // Take tokens scanned elsewhere, e.g. by an IncrementalScanner, instead
+    // of scanning a file. The scanner then behaves as in kScanEager mode.
+    void LoadTokens(const std::string &filename, std::shared_ptr<SourceBuffer> source,
+                    TokenStore tokens);
+
+    // Scan a buffer that is already open from `offset` on, in streaming
+    // mode. Errors are not reported, GetToken() returns kEof from the first
+    // one on, and line numbers are not kept.
+    void ScanSource(std::shared_ptr<SourceBuffer> source, size_t offset = 0);
+
+    // Scan one line on its own, token offsets are relative to the line. On
+    // a lexical error, returns false with the message in `error` and the
+    // 0-based column in `error_col`.
+    bool ScanLine(std::string_view line, std::vector<Token> &tokens,
+                  std::string &error, int &error_col);
+
+    // Read tokens [first, last) of a scanner in an eager mode, which must
+    // outlive this one and not move on meanwhile. kEof follows `last`.
+    // Scanners may share the tokens of one scanner from several threads.
+    void ShareTokens(const Scanner &other, size_t first, size_t last);
+
+    // The eager modes only: the number of tokens, the index of the next
+    // one, moving to another one, and the indices of the kFn tokens outside
+    // of braces from `first` to the end of the file.
+    size_t NumTokens() const { return std::min(token_end_, store_->Size()); }
+    size_t TokenIndex() const { return index_; }
+    void SeekToken(size_t index) { index_ = index; }
+    std::vector<size_t> FindTopLevelFnTokens(size_t first) const;
+
+    Token GetToken();
+    Token Peek(int i);
     const std::string &Filename() const { return filename_; }
+    const std::shared_ptr<SourceBuffer> &Source() const { return source_; }
 
 private:
+    bool NextLine();
+    bool NextToken(Token &tk);
+    bool FillLookahead(int n);
     bool ScanToken(Token &tk);
     void ScanDoubleOrInt(Token &tk);
     void ScanIDOrKeyword(Token &tk);
     void ScanAllTokens();
+    void ScanAllTokensParallel();
+    void SkipDigits();
     void SkipSpaceOrComment();
     void Error();
 
 private:
+    ScanMode mode_;
+    const ScanKernels *kernels_;
+    unsigned num_threads_ = DefaultThreadCount();
+    Interner *interner_ = &Interner::Global();
     std::string filename_;
-    std::ifstream input_;
-    std::vector<Token> tokens_;
-    int index_ = 0;
-    std::string line_;
+    std::shared_ptr<SourceBuffer> source_;
+    std::string_view text_;
+    size_t next_line_ = 0;      // Offset of the first unscanned line.
+    size_t end_ = 0;            // Scanning stops at this offset.
+
+    // Eager mode.
+    TokenStore tokens_;
+    const TokenStore *store_ = &tokens_;    // tokens_, or those of another scanner.
+    size_t index_ = 0;
+    size_t token_end_ = kNoTokenEnd;        // Of the shared tokens.
+
+    // Streaming mode.
+    Token ring_[kLookahead];
+    int ring_head_ = 0;
+    int ring_count_ = 0;
+
+    std::string_view line_;
+    uint32_t line_offset_ = 0;
     int col_ = 0;
     int line_no_ = 0;
 
     std::ostringstream error_;
+    bool exit_on_error_ = true;
+    bool failed_ = false;       // Set by Error() if exit_on_error_ is false.
+    int error_line_no_ = 0;
+    int error_col_ = 0;
+    std::string error_message_;
     Token eop_{kEof, ""};
 };
 
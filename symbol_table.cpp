@@ -1,14 +1,87 @@
 #include "symbol_table.h"
 
-bool SymbolTable::InsertSymbol(const std::string &name, Node *node) {
-    auto res = table_.emplace(name, node);
-    return res.second;
+static uint32_t Hash(Symbol name) {
+    return name * 0x9e3779b1u;
 }
 
-Node *SymbolTable::LookUp(const std::string &name) const {
-    auto it = table_.find(name);
-    if (it == table_.end())
+void SymbolTable::LeaveScope() {
+    const uint32_t first = scope_starts_.back();
+    scope_starts_.pop_back();
+
+    while (bindings_.size() > first) {
+        const Binding &binding = bindings_.back();
+        slots_[Find(binding.name)].head = binding.shadowed;
+        bindings_.pop_back();
+    }
+}
+
+bool SymbolTable::InsertSymbol(Symbol name, SymbolKind kind, void *target) {
+    Slot &slot = FindOrInsert(name);
+    const uint32_t depth = scope_starts_.size();
+    if (slot.head != kNone && bindings_[slot.head].depth == depth)
+        return false;
+
+    bindings_.push_back({target, slot.head, depth, name, kind});
+    slot.head = bindings_.size() - 1;
+    return true;
+}
+
+void *SymbolTable::LookUp(Symbol name, bool is_func, SymbolKind *kind) const {
+    const size_t slot = Find(name);
+    if (slot == slots_.size())
         return nullptr;
 
-    return it->second;
+    for (uint32_t i = slots_[slot].head; i != kNone; i = bindings_[i].shadowed) {
+        if ((bindings_[i].kind == kFunctionSymbol) == is_func) {
+            if (kind)
+                *kind = bindings_[i].kind;
+            return bindings_[i].target;
+        }
+    }
+    return nullptr;
+}
+
+size_t SymbolTable::Find(Symbol name) const {
+    if (slots_.empty())
+        return 0;
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = Hash(name) & mask; ; i = (i + 1) & mask) {
+        if (slots_[i].name == name)
+            return i;
+        if (slots_[i].name == kNoSymbol)
+            return slots_.size();
+    }
+}
+
+// A name keeps its slot once it has one, also while it is unbound.
+SymbolTable::Slot &SymbolTable::FindOrInsert(Symbol name) {
+    if ((num_names_ + 1) * 2 > slots_.size())
+        Grow();
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = Hash(name) & mask; ; i = (i + 1) & mask) {
+        if (slots_[i].name == name)
+            return slots_[i];
+        if (slots_[i].name == kNoSymbol) {
+            ++num_names_;
+            slots_[i].name = name;
+            return slots_[i];
+        }
+    }
+}
+
+void SymbolTable::Grow() {
+    std::vector<Slot> old = std::move(slots_);
+    slots_.assign(old.empty() ? 64 : old.size() * 2, Slot());
+
+    const size_t mask = slots_.size() - 1;
+    for (const Slot &slot : old) {
+        if (slot.name == kNoSymbol)
+            continue;
+        size_t i = Hash(slot.name) & mask;
+        while (slots_[i].name != kNoSymbol)
+            i = (i + 1) & mask;
+        slots_[i] = slot;
+    }
 }
@@ -1,12 +1,65 @@
-#include <memory>
-#include <unordered_map>
+#ifndef SYMBOL_TABLE_H_
+#define SYMBOL_TABLE_H_
+
+#include <cstdint>
+#include <vector>
+
 #include "ast.h"
 
+// What a name is bound to, so that lookups need no RTTI. A tree is checked
+// with names bound to its nodes, a FlatAst with names bound to its records.
+enum SymbolKind : uint8_t {
+    kFunctionSymbol,    // A FuncDefNode, or a FlatFunc.
+    kVariableSymbol,    // A DeclStmtNode of a local, or its kFlatDecl FlatStmt.
+    kParamSymbol,       // A DeclStmtNode in the parameters of a function, or a
+                        // FlatStmt in FlatAst::params.
+    kGlobalSymbol,      // A DeclStmtNode of a global, or its kFlatDecl FlatStmt.
+};
+
+// The names of all scopes in one open-addressing table. The slot of a name
+// holds its innermost binding, which links to the bindings it shadows, so a
+// lookup costs the same however deep the scopes are nested. The bindings are
+// kept in the order they were made, which serves as the undo log that
+// LeaveScope() pops. Nothing is allocated once the table has grown to the
+// program.
 class SymbolTable {
 public:
-    bool InsertSymbol(const std::string &name, Node *node);
-    Node *LookUp(const std::string &name) const;
+    // The outermost scope is open from the start.
+    void EnterScope() { scope_starts_.push_back(bindings_.size()); }
+    void LeaveScope();
+
+    // Bind `name` in the innermost scope, unless it is bound there already.
+    bool InsertSymbol(Symbol name, SymbolKind kind, void *target);
+
+    // The innermost binding of `name` to a function or to something else,
+    // skipping those of the other kind. Its kind goes to `kind`, if given.
+    void *LookUp(Symbol name, bool is_func, SymbolKind *kind = nullptr) const;
 
 private:
-    std::unordered_map<std::string, Node*> table_;
+    static constexpr uint32_t kNone = 0xffffffffu;
+
+    struct Slot {
+        Symbol name = kNoSymbol;
+        uint32_t head = kNone;      // Innermost binding, in bindings_.
+    };
+
+    struct Binding {
+        void *target;
+        uint32_t shadowed;          // The binding it hides, in bindings_.
+        uint32_t depth;             // Of its scope.
+        Symbol name;
+        SymbolKind kind;
+    };
+
+    size_t Find(Symbol name) const;     // Index of its slot, or slots_.size().
+    Slot &FindOrInsert(Symbol name);
+    void Grow();
+
+private:
+    std::vector<Slot> slots_;       // Linear probing, a power of 2 in size.
+    size_t num_names_ = 0;
+    std::vector<Binding> bindings_;
+    std::vector<uint32_t> scope_starts_;
 };
+
+#endif // SYMBOL_TABLE_H_
@@ -0,0 +1,610 @@
+#include "opcode.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/wait.h>
+
+using namespace std;
+
+static const char *const kScratchFile = "test_drivers.c0";
+static const char *const kScratchOutput = "test_drivers.bin";
+
+// Every front end and pass that can be picked on the command line.
+static const vector<string> kModes = {
+    "",
+    "--eager-scan",
+    "--parallel-scan --threads=4",
+    "--parallel-parse --threads=4",
+    "--parallel-check --threads=4",
+    "--parallel-codegen --threads=4",
+    "--flat-ast",
+    "--fused",
+    "--pipeline --threads=4",
+    "--streaming",
+};
+
+// The same with -O, which folds the whole program at once and also works
+// out calls of pure functions with constant arguments. The pipeline and
+// streaming front ends fold each part as soon as it is checked and leave
+// calls to run time, see ConstFolder::FoldFunction(), so they write other
+// code that has to compute the same. --flat-ast has no -O.
+static const vector<string> kOptimized = {
+    "-O",
+    "-O --eager-scan",
+    "-O --parallel-scan --threads=4",
+    "-O --parallel-parse --threads=4",
+    "-O --parallel-check --threads=4",
+    "-O --parallel-codegen --threads=4",
+    "-O --fused",
+};
+static const vector<string> kPartwiseOptimized = {
+    "-O --pipeline --threads=4",
+    "-O --streaming",
+};
+
+// Locals in nested blocks, in loops and in the parts of an if statement,
+// some of them shadowing others, and globals set from them.
+static const char *const kNestedBlocks = R"(let g: int = 1;
+let h: double;
+
+fn f(n: int, x: double) -> int {
+    let a: int = n;
+    {
+        let b: int = a + 1;
+        {
+            let a: int = b * 2;
+            b = a;
+        }
+        a = b;
+    }
+    while a > 0 {
+        let c: int = a - 1;
+        if c == 3 {
+            let d: int = c;
+            a = d - 10;
+        } else if c > 10 {
+            let x: double = 1.5;
+            h = x;
+            a = c / 2;
+        } else {
+            let a: int = c;
+            g = a;
+        }
+        a = a - 1;
+    }
+    {
+        let y: double = x;
+        h = y;
+    }
+    return a;
+}
+
+fn main() -> void {
+    let x: int = 0;
+    if g > 0 {
+        let y: int = g;
+        {
+            let g: int = y + 1;
+            x = g;
+        }
+    }
+    g = x;
+}
+)";
+
+// Calls with arguments, some of which -O works out, also of functions with
+// loops and if statements. The globals are set by _start, which RunStart()
+// runs.
+static const char *const kCalls = R"(const k: int = 3;
+let r1: int = sq(4);
+let r2: int = sum3(1, sq(2), -3);
+let r3: int = sum3(k, k + 1, sq(k));
+let r4: double = scale(1.5, 2);
+let r5: int = sq(r1) - r2;
+let r6: int = loop(5);
+let r7: int = rank(1) * 100 + rank(3) * 10 + rank(7);
+let r8: int = loop(rank(k) + 2);
+
+fn sq(x: int) -> int {
+    return x * x;
+}
+
+fn sum3(a: int, b: int, c: int) -> int {
+    return a * 100 + b * 10 + c;
+}
+
+fn scale(x: double, n: int) -> double {
+    let y: double = x * 2.0;
+    return y - x / 4.0;
+}
+
+fn loop(n: int) -> int {
+    let s: int = 0;
+    while n > 0 {
+        s = s + n;
+        n = n - 1;
+    }
+    return s;
+}
+
+fn rank(x: int) -> int {
+    if x < 3 {
+        return 1;
+    } else if x == 3 {
+        return 2;
+    } else {
+        return 3;
+    }
+}
+)";
+
+static uint64_t DoubleBits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static const vector<uint64_t> kCallsGlobals = {
+    3, 16, 137, 349, DoubleBits(2.625), 119, 15, 123, 10,
+};
+
+static bool ReadFile(const string &filename, string &text) {
+    ifstream in(filename, ios::binary);
+    if (!in)
+        return false;
+    ostringstream out;
+    out << in.rdbuf();
+    text = out.str();
+    return true;
+}
+
+// The binary that the compiler writes with the given flags, or false with
+// what it printed.
+static bool Compile(const string &compiler, const string &flags, string &binary) {
+    remove(kScratchOutput);
+    const string command = "\"" + compiler + "\" " + flags + " " + kScratchFile + " " +
+                           kScratchOutput + " 2>&1";
+    string output;
+    int status = -1;
+    if (FILE *pipe = popen(command.c_str(), "r")) {
+        char buffer[256];
+        while (fgets(buffer, sizeof(buffer), pipe))
+            output += buffer;
+        status = pclose(pipe);
+    }
+
+    if (status != 0 || !ReadFile(kScratchOutput, binary)) {
+        binary = output;
+        return false;
+    }
+    return true;
+}
+
+// A function of a binary, with the operand of each instruction.
+struct VmFunc {
+    uint32_t return_slots = 0;
+    uint32_t param_slots = 0;
+    uint32_t loc_slots = 0;
+    vector<pair<uint8_t, uint64_t>> code;
+};
+
+struct VmProgram {
+    vector<uint64_t> globals;       // The values of the 8-byte ones.
+    vector<VmFunc> functions;
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(const string &data) : data_(data) {}
+
+    bool Done() const { return ok_ && pos_ == data_.size(); }
+    bool Ok() const { return ok_; }
+
+    uint64_t Read(size_t n, bool little_endian) {
+        if (!ok_ || data_.size() - pos_ < n) {
+            ok_ = false;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t byte = static_cast<uint8_t>(data_[pos_ + i]);
+            value |= byte << 8 * (little_endian ? i : n - 1 - i);
+        }
+        pos_ += n;
+        return value;
+    }
+
+    uint32_t ReadU32() { return Read(4, false); }
+
+private:
+    const string &data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+// The operands that the Compiler packs in 32 bits come out little-endian,
+// and every other instruction has 64 big-endian bits.
+static bool HasU32Operand(uint8_t opcode) {
+    switch (opcode) {
+    case kOpCodePopn:
+    case kOpCodeLoca:
+    case kOpCodeArga:
+    case kOpCodeGloba:
+    case kOpCodeStackalloc:
+    case kOpCodeBr:
+    case kOpCodeBrFalse:
+    case kOpCodeBrTrue:
+    case kOpCodeCall:
+    case kOpCodeCallname:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool ReadBinary(const string &binary, VmProgram &program) {
+    BinaryReader in(binary);
+    if (in.ReadU32() != 0x72303b3e || in.ReadU32() != 1)
+        return false;
+
+    const uint32_t num_globals = in.ReadU32();
+    for (uint32_t i = 0; i < num_globals && in.Ok(); ++i) {
+        in.Read(1, false);
+        const uint32_t size = in.ReadU32();
+        program.globals.push_back(size == 8 ? in.Read(8, true) : (in.Read(size, false), 0));
+    }
+
+    const uint32_t num_functions = in.ReadU32();
+    for (uint32_t i = 0; i < num_functions && in.Ok(); ++i) {
+        VmFunc func;
+        in.ReadU32();
+        func.return_slots = in.ReadU32();
+        func.param_slots = in.ReadU32();
+        func.loc_slots = in.ReadU32();
+        const uint32_t num_insts = in.ReadU32();
+        for (uint32_t j = 0; j < num_insts && in.Ok(); ++j) {
+            const uint8_t opcode = in.Read(1, false);
+            const bool is_u32 = HasU32Operand(opcode);
+            func.code.emplace_back(opcode, in.Read(is_u32 ? 4 : 8, is_u32));
+        }
+        program.functions.push_back(move(func));
+    }
+    return in.Done();
+}
+
+// Run _start, the last function, which sets the global variables. The
+// builtins, which do the I/O, are not known. Addresses are indexes of stack
+// slots, or of globals with kGlobal set. A branch adds its offset to the
+// index of the instruction after it.
+static bool RunStart(VmProgram &program, string &error) {
+    constexpr uint64_t kGlobal = uint64_t(1) << 63;
+    constexpr size_t kMaxSteps = 1000000;
+
+    struct Frame {
+        const VmFunc *func;
+        size_t pc;
+        size_t args;                // The return slots, then the parameters.
+        size_t locals;
+    };
+
+    vector<uint64_t> stack;
+    vector<Frame> frames;
+    if (program.functions.empty()) {
+        error = "no functions";
+        return false;
+    }
+    const VmFunc &start = program.functions.back();
+    frames.push_back({&start, 0, 0, 0});
+    stack.resize(start.loc_slots);
+
+    bool ok = true;
+    auto pop = [&]() -> uint64_t {
+        if (stack.size() <= frames.back().locals + frames.back().func->loc_slots) {
+            ok = false;
+            return 0;
+        }
+        const uint64_t value = stack.back();
+        stack.pop_back();
+        return value;
+    };
+    auto slot = [&](uint64_t addr) -> uint64_t * {
+        if (addr & kGlobal) {
+            addr &= ~kGlobal;
+            return addr < program.globals.size() ? &program.globals[addr] : nullptr;
+        }
+        return addr < stack.size() ? &stack[addr] : nullptr;
+    };
+    auto as_double = [](uint64_t bits) {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    };
+
+    for (size_t steps = 0; steps < kMaxSteps; ++steps) {
+        Frame &frame = frames.back();
+        if (frame.pc == frame.func->code.size()) {
+            if (frames.size() == 1)
+                return true;
+            error = "ran off the end of a function";
+            return false;
+        }
+
+        const auto [opcode, operand] = frame.func->code[frame.pc++];
+        uint64_t a = 0;
+        uint64_t b = 0;
+        switch (opcode) {
+        case kOpCodePush:
+            stack.push_back(operand);
+            break;
+        case kOpCodePopn:
+            for (uint64_t i = 0; i < operand; ++i)
+                pop();
+            break;
+        case kOpCodeLoca:
+            stack.push_back(frame.locals + operand);
+            break;
+        case kOpCodeArga:
+            stack.push_back(frame.args + operand);
+            break;
+        case kOpCodeGloba:
+            stack.push_back(kGlobal | operand);
+            break;
+        case kOpCodeLoad64: {
+            const uint64_t *value = slot(pop());
+            ok = ok && value;
+            stack.push_back(value ? *value : 0);
+            break;
+        }
+        case kOpCodeStore64: {
+            b = pop();
+            uint64_t *value = slot(pop());
+            ok = ok && value;
+            if (value)
+                *value = b;
+            break;
+        }
+        case kOpCodeStackalloc:
+            stack.resize(stack.size() + operand);
+            break;
+        case kOpCodeAddI:
+        case kOpCodeSubI:
+        case kOpCodeMulI:
+        case kOpCodeDivI:
+            b = pop();
+            a = pop();
+            if (opcode == kOpCodeDivI && (b == 0 || (int64_t(a) == INT64_MIN && int64_t(b) == -1))) {
+                error = "division trap";
+                return false;
+            }
+            stack.push_back(opcode == kOpCodeAddI ? a + b :
+                            opcode == kOpCodeSubI ? a - b :
+                            opcode == kOpCodeMulI ? a * b :
+                            uint64_t(int64_t(a) / int64_t(b)));
+            break;
+        case kOpCodeAddF:
+        case kOpCodeSubF:
+        case kOpCodeMulF:
+        case kOpCodeDivF: {
+            const double y = as_double(pop());
+            const double x = as_double(pop());
+            stack.push_back(DoubleBits(opcode == kOpCodeAddF ? x + y :
+                                       opcode == kOpCodeSubF ? x - y :
+                                       opcode == kOpCodeMulF ? x * y : x / y));
+            break;
+        }
+        case kOpCodeCmpI: {
+            const int64_t y = pop();
+            const int64_t x = pop();
+            stack.push_back((x > y) - (x < y));
+            break;
+        }
+        case kOpCodeCmpF: {
+            const double y = as_double(pop());
+            const double x = as_double(pop());
+            stack.push_back((x > y) - (x < y));
+            break;
+        }
+        case kOpCodeNegI:
+            stack.push_back(0 - pop());
+            break;
+        case kOpCodeNegF:
+            stack.push_back(DoubleBits(-as_double(pop())));
+            break;
+        case kOpCodeSetLt:
+            stack.push_back(int64_t(pop()) < 0);
+            break;
+        case kOpCodeSetGt:
+            stack.push_back(int64_t(pop()) > 0);
+            break;
+        case kOpCodeNot:
+            stack.push_back(pop() == 0);
+            break;
+        case kOpCodeBr:
+        case kOpCodeBrFalse:
+        case kOpCodeBrTrue:
+            if (opcode != kOpCodeBr && (pop() != 0) != (opcode == kOpCodeBrTrue))
+                break;
+            frame.pc += int32_t(operand);
+            if (frame.pc > frame.func->code.size()) {
+                error = "branch out of the function";
+                return false;
+            }
+            break;
+        case kOpCodeCall: {
+            if (operand >= program.functions.size()) {
+                ok = false;
+                break;
+            }
+            const VmFunc &callee = program.functions[operand];
+            const size_t frame_slots = callee.return_slots + callee.param_slots;
+            if (stack.size() < frame.locals + frame.func->loc_slots + frame_slots) {
+                ok = false;
+                break;
+            }
+            const size_t args = stack.size() - frame_slots;
+            frames.push_back({&callee, 0, args, stack.size()});
+            stack.resize(stack.size() + callee.loc_slots);
+            break;
+        }
+        case kOpCodeRet:
+            if (frames.size() == 1) {
+                error = "_start returned";
+                return false;
+            }
+            stack.resize(frame.args + frame.func->return_slots);
+            frames.pop_back();
+            break;
+        default:
+            error = "unknown instruction " + to_string(opcode);
+            return false;
+        }
+
+        if (!ok) {
+            error = "bad operand of instruction " + to_string(opcode);
+            return false;
+        }
+    }
+    error = "too many steps";
+    return false;
+}
+
+// Compile a program in all of the modes, which must write the same binary,
+// and return that in `binary`.
+static bool CheckSameBinary(const string &compiler, const string &name,
+                            const vector<string> &modes, string &binary) {
+    if (!Compile(compiler, modes[0], binary)) {
+        cout << name << ": the compile with " << modes[0] << " failed: " << binary;
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t i = 1; i < modes.size(); ++i) {
+        string actual;
+        if (!Compile(compiler, modes[i], actual)) {
+            cout << name << ": the compile with " << modes[i] << " failed: " << actual;
+            ok = false;
+        } else if (actual != binary) {
+            cout << name << ": " << modes[i] << " writes another binary than " << modes[0] << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static void WriteProgram(const string &program) {
+    ofstream out(kScratchFile, ios::binary);
+    out << program;
+}
+
+static bool CheckNestedBlocks(const string &compiler) {
+    WriteProgram(kNestedBlocks);
+
+    vector<string> optimized = kOptimized;
+    optimized.insert(optimized.end(), kPartwiseOptimized.begin(), kPartwiseOptimized.end());
+    string plain_binary;
+    string optimized_binary;
+    const bool plain_ok = CheckSameBinary(compiler, "nested blocks", kModes, plain_binary);
+    return CheckSameBinary(compiler, "nested blocks -O", optimized, optimized_binary) && plain_ok;
+}
+
+// Without -O, with -O as a whole and with -O part by part, the code has to
+// compute the same values.
+static bool CheckCalls(const string &compiler) {
+    WriteProgram(kCalls);
+
+    const vector<pair<string, const vector<string> *>> groups = {
+        {"calls", &kModes},
+        {"calls -O", &kOptimized},
+        {"calls -O part by part", &kPartwiseOptimized},
+    };
+    bool ok = true;
+    for (const auto &[name, modes] : groups) {
+        string binary;
+        if (!CheckSameBinary(compiler, name, *modes, binary)) {
+            ok = false;
+            continue;
+        }
+
+        VmProgram program;
+        string error;
+        if (!ReadBinary(binary, program)) {
+            cout << name << ": cannot read the binary" << endl;
+            ok = false;
+        } else if (!RunStart(program, error)) {
+            cout << name << ": " << error << endl;
+            ok = false;
+        } else if (program.globals.size() < kCallsGlobals.size() ||
+                   !equal(kCallsGlobals.begin(), kCallsGlobals.end(), program.globals.begin())) {
+            cout << name << ": the globals are";
+            for (size_t i = 0; i < kCallsGlobals.size() && i < program.globals.size(); ++i)
+                cout << ' ' << program.globals[i];
+            cout << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// A failed compile must report the error, exiting with 1, and leave an
+// existing output file as it was, in every mode, also the streaming one,
+// which writes the output as it goes.
+static bool CheckFailedCompile(const string &compiler) {
+    static const char *const kPrevious = "previous output";
+    const vector<pair<string, string>> programs = {
+        {"a syntax error", "fn main() -> void {\n    let a: int = ;\n}\n"},
+        {"a semantic error", "fn f() -> int {\n    return 1;\n}\n\nfn main() -> void {\n    a = f();\n}\n"},
+        {"a missing return value", "fn f() -> int {\n    return;\n}\n\nfn main() -> void {\n}\n"},
+    };
+
+    bool ok = true;
+    for (const auto &[name, program] : programs) {
+        WriteProgram(program);
+        for (const string &mode : kModes) {
+            {
+                ofstream out(kScratchOutput, ios::binary);
+                out << kPrevious;
+            }
+            const string command = "\"" + compiler + "\" " + mode + " " + kScratchFile + " " +
+                                   kScratchOutput + " > /dev/null 2>&1";
+            string output;
+            const int status = system(command.c_str());
+            if (status == 0) {
+                cout << mode << ": compiled a program with " << name << endl;
+                ok = false;
+            } else if (!WIFEXITED(status) || WEXITSTATUS(status) != 1) {
+                cout << mode << ": did not report " << name << endl;
+                ok = false;
+            } else if (!ReadFile(kScratchOutput, output) || output != kPrevious) {
+                cout << mode << ": " << name << " changed the output file" << endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        cout << "Usage: " << argv[0] << " compiler" << endl;
+        return 1;
+    }
+
+    bool ok = CheckNestedBlocks(argv[1]);
+    ok = CheckCalls(argv[1]) && ok;
+    ok = CheckFailedCompile(argv[1]) && ok;
+
+    remove(kScratchFile);
+    remove(kScratchOutput);
+    cout << (ok ? "ok" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include "analyzer.h"
+#include "compiler.h"
+#include "flat_ast.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+static const char *const kScratchFile = "test_flat_ast.c0";
+
+// Every kind of statement and expression, with globals, parameters and
+// calls in both directions.
+static const char *const kProgram = R"(let total: int = 0;
+const scale: double = 1.5;
+let ratio: double;
+
+fn square(x: int) -> int {
+    return x * x;
+}
+
+fn step(n: int, d: double) -> double {
+    let i: int = 0;
+    let acc: double = d;
+    while i < n {
+        if i == 2 {
+            acc = acc * scale;
+        } else if i > 5 {
+            acc = acc - -d / 2.0;
+        } else {
+            acc = acc + 1.0;
+        }
+        i = i + 1;
+    }
+    total = total + square(n);
+    return acc;
+}
+
+fn main() -> void {
+    const base: int = 3;
+    let r: double = step(square(base) - 1, 0.25);
+    ratio = r;
+    if r >= 1.0 {
+        total = -total;
+    }
+    return;
+}
+)";
+
+// The tokens and AST keep views into the source, so each compile parses the
+// file on its own.
+static string CompileTree() {
+    Parser parser;
+    Ptr<ProgramNode> program = parser.ParseFile(kScratchFile);
+    TypeChecker checker(kScratchFile);
+    program->Accept(checker);
+
+    ostringstream out;
+    Compiler compiler(out);
+    compiler.Compile(program.get());
+    return out.str();
+}
+
+static bool CheckStructure(const FlatAst &ast) {
+    for (uint32_t i = 0; i < ast.exprs.size(); ++i) {
+        if (ast.exprs[i].first > i) {
+            cout << "expression " << i << " starts after itself" << endl;
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < ast.stmts.size(); ++i) {
+        if (ast.End(i) <= i || ast.End(i) > ast.stmts.size()) {
+            cout << "statement " << i << " ends at " << ast.End(i) << endl;
+            return false;
+        }
+    }
+    for (const FlatFunc &func : ast.functions) {
+        if (ast.stmts[func.body].kind != kFlatBlock) {
+            cout << "the body of " << SymbolName(func.name) << " is not a block" << endl;
+            return false;
+        }
+    }
+    if (ast.functions.size() != 3 || ast.globals.size() != 3) {
+        cout << ast.functions.size() << " functions and " << ast.globals.size()
+             << " globals, expected 3 and 3" << endl;
+        return false;
+    }
+    return true;
+}
+
+static bool CompileFlat(string &binary) {
+    Parser parser;
+    Ptr<ProgramNode> program = parser.ParseFile(kScratchFile);
+    FlatAst ast = Flatten(*program);
+    program.reset();
+    if (!CheckStructure(ast))
+        return false;
+
+    TypeChecker checker(kScratchFile);
+    checker.Check(ast);
+
+    ostringstream out;
+    Compiler compiler(out);
+    compiler.Compile(ast);
+    binary = out.str();
+    return true;
+}
+
+int main() {
+    {
+        ofstream out(kScratchFile, ios::binary);
+        out << kProgram;
+    }
+
+    string flat;
+    bool ok = CompileFlat(flat);
+    if (ok && flat != CompileTree()) {
+        cout << "the flat AST compiles to a different binary than the tree" << endl;
+        ok = false;
+    }
+
+    remove(kScratchFile);
+    cout << (ok ? "ok" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include "corpus_gen.h"
+#include "incremental_scanner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char *const kScratchFile = "test_incremental_scan.c0";
+
+static vector<string> SplitLines(const string &text) {
+    vector<string> lines;
+    istringstream in(text);
+    for (string line; getline(in, line);)
+        lines.push_back(line);
+    return lines;
+}
+
+static string JoinLines(const vector<string> &lines) {
+    string text;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (i > 0)
+            text += '\n';
+        text += lines[i];
+    }
+    return text;
+}
+
+// Apply edits to plain lines, one at a time from the last one up.
+static void ApplyEdits(vector<string> &lines, vector<LineEdit> edits) {
+    sort(edits.begin(), edits.end(), [](const LineEdit &a, const LineEdit &b) {
+        return a.first_line > b.first_line;
+    });
+    for (const LineEdit &edit : edits) {
+        auto first = lines.begin() + (edit.first_line - 1);
+        first = lines.erase(first, first + edit.num_lines);
+        lines.insert(first, edit.new_lines.begin(), edit.new_lines.end());
+    }
+}
+
+// Compare the text of an IncrementalScanner with the expected lines, and
+// its tokens with those of a full scan of that text.
+static bool MatchesRescan(const IncrementalScanner &incremental, const vector<string> &lines,
+                          int round) {
+    TokenStore store;
+    shared_ptr<SourceBuffer> source = incremental.Export(store);
+    if (source->Text() != JoinLines(lines)) {
+        cout << "round " << round << ": the text differs from the edited lines" << endl;
+        return false;
+    }
+    {
+        ofstream out(kScratchFile, ios::binary);
+        out << source->Text();
+    }
+
+    Scanner scanner(kScanEager);
+    scanner.ScanFile(kScratchFile);
+    size_t i = 0;
+    for (;; ++i) {
+        Token expected = scanner.GetToken();
+        if (expected.type == kEof || i == store.Size()) {
+            if (expected.type == kEof && i == store.Size())
+                return true;
+            break;
+        }
+
+        Token actual = store.At(i, source->Text());
+        if (expected.type != actual.type || expected.lexeme != actual.lexeme ||
+            expected.pos.offset != actual.pos.offset || expected.int_value != actual.int_value ||
+            (expected.type == kIdent && SymbolName(expected.sym) != SymbolName(actual.sym))) {
+            break;
+        }
+    }
+
+    cout << "round " << round << ": differs from a full scan at token " << i << " of "
+         << store.Size() << endl;
+    return false;
+}
+
+// Random edits that neither overlap nor share a first line: replacements,
+// insertions and deletions, with lines taken from `pool`.
+static vector<LineEdit> RandomEdits(mt19937 &rng, size_t num_lines, const vector<string> &pool) {
+    vector<uint32_t> starts;
+    const size_t num_edits = 1 + rng() % 8;
+    for (size_t i = 0; i < num_edits; ++i)
+        starts.push_back(1 + rng() % (num_lines + 1));
+    sort(starts.begin(), starts.end());
+    starts.erase(unique(starts.begin(), starts.end()), starts.end());
+
+    vector<LineEdit> edits;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        const uint32_t limit = (i + 1 < starts.size() ? starts[i + 1] : num_lines + 1) - starts[i];
+        LineEdit edit;
+        edit.first_line = starts[i];
+        edit.num_lines = rng() % (min<uint32_t>(limit, 4) + 1);
+        const size_t num_new = rng() % 4;
+        for (size_t j = 0; j < num_new; ++j)
+            edit.new_lines.push_back(pool[rng() % pool.size()]);
+        edits.push_back(edit);
+    }
+    shuffle(edits.begin(), edits.end(), rng);
+    return edits;
+}
+
+// Edits that must be rejected, leaving the text as it is.
+static bool CheckRejected(IncrementalScanner &incremental) {
+    const size_t n = incremental.NumLines();
+    const vector<vector<LineEdit>> bad = {
+        {{0, 1, {"let x: int = 1;"}}},
+        {{uint32_t(n), 2, {}}},
+        {{uint32_t(n + 2), 0, {"let x: int = 1;"}}},
+        {{3, 2, {}}, {4, 1, {}}},
+        {{5, 0, {"let a: int = 1;"}}, {5, 0, {"let b: int = 2;"}}},
+        {{7, 1, {}}, {7, 0, {"let c: int = 3;"}}},
+    };
+
+    TokenStore before_tokens;
+    const string before(incremental.Export(before_tokens)->Text());
+    for (size_t i = 0; i < bad.size(); ++i) {
+        string error;
+        if (incremental.Update(bad[i], error) || error.empty()) {
+            cout << "bad edit " << i << " was accepted" << endl;
+            return false;
+        }
+
+        TokenStore tokens;
+        if (incremental.Export(tokens)->Text() != before) {
+            cout << "bad edit " << i << " changed the text" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    CorpusOptions options;
+    options.size = 64 << 10;
+    ostringstream corpus;
+    GenerateCorpus(options, corpus);
+    const vector<string> pool = SplitLines(corpus.str());
+
+    vector<string> lines = pool;
+    IncrementalScanner incremental;
+    incremental.Load(JoinLines(lines));
+    bool ok = MatchesRescan(incremental, lines, 0) && CheckRejected(incremental);
+
+    mt19937 rng(7);
+    for (int round = 1; ok && round <= 200; ++round) {
+        const vector<LineEdit> edits = RandomEdits(rng, incremental.NumLines(), pool);
+        string error;
+        if (!incremental.Update(edits, error)) {
+            cout << "round " << round << ": " << error << endl;
+            ok = false;
+            break;
+        }
+        ApplyEdits(lines, edits);
+        ok = MatchesRescan(incremental, lines, round);
+    }
+
+    remove(kScratchFile);
+    cout << (ok ? "ok" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+#include "corpus_gen.h"
+#include "flat_ast.h"
+#include "parser.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char *const kScratchFile = "test_parallel_parse.c0";
+static const char *const kScratchOutput = "test_parallel_parse.bin";
+
+static const vector<unsigned> kThreadCounts{2, 3, 5, 8};
+
+static void WriteFile(const string &filename, const string &text) {
+    ofstream out(filename, ios::binary);
+    out << text;
+}
+
+// The printed tree, which has no positions, then the positions of all
+// nodes in the order of the flattened tree.
+static string Describe(ProgramNode &program) {
+    ostringstream out;
+    program.Print(out);
+
+    FlatAst ast = Flatten(program);
+    for (const FlatStmt &stmt : ast.globals)
+        out << stmt.pos.offset << ' ';
+    for (const FlatStmt &stmt : ast.params)
+        out << stmt.pos.offset << ' ';
+    for (const FlatFunc &func : ast.functions)
+        out << func.pos.offset << ' ';
+    for (const FlatStmt &stmt : ast.stmts)
+        out << stmt.pos.offset << ' ';
+    for (const FlatExpr &expr : ast.exprs)
+        out << expr.pos.offset << ' ';
+    return out.str();
+}
+
+static string ParseAndDescribe(unsigned num_threads) {
+    Parser parser(kScanEager);
+    parser.SetParseThreads(num_threads);
+    Ptr<ProgramNode> program = parser.ParseFile(kScratchFile);
+    return Describe(*program);
+}
+
+static bool CheckValid(const string &text) {
+    WriteFile(kScratchFile, text);
+    const string expected = ParseAndDescribe(1);
+
+    bool ok = true;
+    for (unsigned num_threads : kThreadCounts) {
+        if (ParseAndDescribe(num_threads) != expected) {
+            cout << "the tree parsed on " << num_threads << " threads differs" << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// A syntax error exits the compiler, so those inputs go through it.
+static string RunCompiler(const string &compiler, unsigned num_threads) {
+    const string command = "\"" + compiler + "\" --eager-scan --parallel-parse --threads=" +
+                           to_string(num_threads) + " " + kScratchFile + " " + kScratchOutput +
+                           " 2>&1";
+    string output;
+    if (FILE *pipe = popen(command.c_str(), "r")) {
+        char buffer[256];
+        while (fgets(buffer, sizeof(buffer), pipe))
+            output += buffer;
+        pclose(pipe);
+    }
+    remove(kScratchOutput);
+    return output;
+}
+
+// Put a bad statement at the top of each of the given functions, and check
+// that every number of threads reports the one in the first of them.
+static bool CheckErrors(const string &compiler, const vector<string> &lines,
+                        const vector<size_t> &fn_lines, const vector<size_t> &bad_funcs) {
+    static const char *const kBadLines[] = {
+        "    let = 1;",
+        "    n = (1 + ;",
+        "    n = f_0(1, 2 {",
+    };
+
+    string text;
+    size_t expected_line = 0;
+    size_t next_bad = 0;
+    size_t line_no = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        text += lines[i] + '\n';
+        ++line_no;
+        if (next_bad < bad_funcs.size() && i == fn_lines[bad_funcs[next_bad]]) {
+            text += kBadLines[next_bad % 3];
+            text += '\n';
+            ++line_no;
+            if (next_bad == 0)
+                expected_line = line_no;
+            ++next_bad;
+        }
+    }
+    WriteFile(kScratchFile, text);
+
+    const string expected = RunCompiler(compiler, 1);
+    const string prefix = string(kScratchFile) + ":" + to_string(expected_line) + ":";
+    if (expected.compare(0, prefix.size(), prefix) != 0) {
+        cout << "expected an error at line " << expected_line << ", got: " << expected;
+        return false;
+    }
+
+    bool ok = true;
+    for (unsigned num_threads : kThreadCounts) {
+        const string actual = RunCompiler(compiler, num_threads);
+        if (actual != expected) {
+            cout << num_threads << " threads report: " << actual << "instead of: " << expected;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        cout << "Usage: " << argv[0] << " compiler" << endl;
+        return 1;
+    }
+
+    // About 500 functions, enough for a few chunks on each thread.
+    CorpusOptions options;
+    options.size = 1 << 20;
+    ostringstream corpus;
+    GenerateCorpus(options, corpus);
+    const string text = corpus.str();
+    bool ok = CheckValid(text);
+
+    vector<string> lines;
+    vector<size_t> fn_lines;
+    istringstream in(text);
+    for (string line; getline(in, line);) {
+        if (line.compare(0, 3, "fn ") == 0)
+            fn_lines.push_back(lines.size());
+        lines.push_back(line);
+    }
+
+    const size_t n = fn_lines.size();
+    const vector<vector<size_t>> cases = {
+        {n / 10, n * 4 / 10, n * 7 / 10, n - 1},
+        {0, n / 2, n - 1},
+        {n / 3, n / 3 + 1},
+        {n - 1},
+    };
+    for (const vector<size_t> &bad_funcs : cases)
+        ok = CheckErrors(argv[1], lines, fn_lines, bad_funcs) && ok;
+
+    remove(kScratchFile);
+    cout << (ok ? "ok" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
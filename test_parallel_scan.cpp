@@ -0,0 +1,109 @@
+#include "corpus_gen.h"
+#include "scanner.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// The lexemes point into the scanner's source buffer, which is returned
+// through `source` to keep it alive.
+static vector<Token> ScanAll(const string &filename, ScanMode mode, unsigned num_threads,
+                             shared_ptr<SourceBuffer> &source) {
+    Scanner scanner(mode);
+    scanner.SetThreads(num_threads);
+    scanner.ScanFile(filename);
+    source = scanner.Source();
+
+    vector<Token> tokens;
+    while (true) {
+        Token tk = scanner.GetToken();
+        if (tk.type == kEof)
+            break;
+        tokens.push_back(tk);
+    }
+    return tokens;
+}
+
+static bool SameToken(const Token &a, const Token &b) {
+    if (a.type != b.type || a.lexeme != b.lexeme || a.pos.offset != b.pos.offset)
+        return false;
+    if (a.type == kIdent)
+        return SymbolName(a.sym) == SymbolName(b.sym);
+    if (a.type == kIntLiteral || a.type == kDoubleLiteral)
+        return a.int_value == b.int_value;
+    return true;
+}
+
+// Scan a file serially and with the given numbers of threads, which split
+// it at different lines, and compare the token streams.
+static bool CheckFile(const string &filename, const vector<unsigned> &thread_counts) {
+    shared_ptr<SourceBuffer> expected_source;
+    vector<Token> expected = ScanAll(filename, kScanEager, 1, expected_source);
+
+    bool ok = true;
+    for (unsigned num_threads : thread_counts) {
+        shared_ptr<SourceBuffer> actual_source;
+        vector<Token> actual = ScanAll(filename, kScanParallel, num_threads, actual_source);
+
+        size_t i = 0;
+        while (i < expected.size() && i < actual.size() && SameToken(expected[i], actual[i]))
+            ++i;
+        if (i < expected.size() || i < actual.size()) {
+            cout << filename << ": " << num_threads << " threads differ at token " << i;
+            if (i < expected.size()) {
+                cout << " (" << expected_source->LineNo(expected[i].pos) << ", "
+                     << expected_source->ColNo(expected[i].pos) << ")";
+            }
+            cout << ", " << actual.size() << " tokens, expected " << expected.size() << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static void WriteFile(const string &filename, const string &text) {
+    ofstream out(filename, ios::binary);
+    out << text;
+}
+
+int main() {
+    // Chunks are at least 256 KB, so this gives up to 12 of them.
+    CorpusOptions options;
+    options.size = 3 << 20;
+    ostringstream corpus;
+    GenerateCorpus(options, corpus);
+    const string text = corpus.str();
+
+    string crlf;
+    crlf.reserve(text.size() * 21 / 20);
+    for (char c : text) {
+        if (c == '\n')
+            crlf.push_back('\r');
+        crlf.push_back(c);
+    }
+
+    string unterminated = text;
+    while (!unterminated.empty() && unterminated.back() == '\n')
+        unterminated.pop_back();
+
+    const vector<unsigned> thread_counts{2, 3, 5, 8, 12};
+    bool ok = true;
+    for (const auto &[name, content] : {pair<string, const string &>{"lf", text},
+                                        {"crlf", crlf},
+                                        {"unterminated", unterminated}}) {
+        const string filename = "test_parallel_scan_" + name + ".c0";
+        WriteFile(filename, content);
+        ok = CheckFile(filename, thread_counts) && ok;
+        remove(filename.c_str());
+    }
+
+    cout << (ok ? "ok" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
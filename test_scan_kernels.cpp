@@ -0,0 +1,141 @@
+#include "scanner.h"
+#include "scan_kernels.h"
+
+#include <cctype>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The character classes of the original scanner, which used <cctype> in
+// the "C" locale, and took letters, digits and '_' for identifiers.
+static bool IsSpaceReference(char c) {
+    return isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+static bool IsDigitReference(char c) {
+    return isdigit(static_cast<unsigned char>(c)) != 0;
+}
+
+static bool IsIdentReference(char c) {
+    const unsigned char u = static_cast<unsigned char>(c);
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || isdigit(u) || u == '_';
+}
+
+static size_t SpanReference(const char *p, size_t n, bool (*in_class)(char)) {
+    size_t i = 0;
+    while (i < n && in_class(p[i]))
+        ++i;
+    return i;
+}
+
+static bool CheckSpans(const ScanKernels &kernels, const string &s) {
+    for (size_t start = 0; start <= s.size(); ++start) {
+        const char *p = s.data() + start;
+        size_t n = s.size() - start;
+        if (kernels.span_space(p, n) != SpanReference(p, n, IsSpaceReference) ||
+            kernels.span_digit(p, n) != SpanReference(p, n, IsDigitReference) ||
+            kernels.span_ident(p, n) != SpanReference(p, n, IsIdentReference)) {
+            cout << kernels.name << ": mismatch at offset " << start
+                 << " of \"" << s << "\"" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Compare a kernel against the original character classes, first on every
+// byte value alone and in runs as long as a vector, then on random strings.
+// The alphabet is biased towards the character classes so that long runs
+// occur.
+static bool CheckKernels(const ScanKernels &kernels) {
+    for (int c = 0; c < 256; ++c) {
+        for (size_t len : {1, 15, 16, 17, 31, 32, 33, 64}) {
+            if (!CheckSpans(kernels, string(len, static_cast<char>(c))))
+                return false;
+        }
+    }
+
+    const string alphabet = " \t\r\v\f\n_09azAZ5mQ+-/.(){}\x7f\x80\xff";
+    mt19937 rng(12345);
+    for (int round = 0; round < 20000; ++round) {
+        size_t len = rng() % 100;
+        string s;
+        char run = alphabet[rng() % alphabet.size()];
+        for (size_t i = 0; i < len; ++i) {
+            if (rng() % 8 == 0)
+                run = alphabet[rng() % alphabet.size()];
+            s.push_back(rng() % 4 == 0 ? static_cast<char>(rng()) : run);
+        }
+
+        if (!CheckSpans(kernels, s))
+            return false;
+    }
+    return true;
+}
+
+// The lexemes point into the scanner's source buffer, which is returned
+// through `source` to keep it alive.
+static vector<Token> ScanAll(const char *filename, const ScanKernels &kernels,
+                             shared_ptr<SourceBuffer> &source) {
+    Scanner scanner(kScanEager);
+    scanner.SetKernels(kernels);
+    scanner.ScanFile(filename);
+    source = scanner.Source();
+
+    vector<Token> tokens;
+    while (true) {
+        Token tk = scanner.GetToken();
+        if (tk.type == kEof)
+            break;
+        tokens.push_back(tk);
+    }
+    return tokens;
+}
+
+// Scan a file with the scalar kernels and with the given ones, and compare
+// the token streams.
+static bool CheckFile(const char *filename, const ScanKernels &kernels) {
+    shared_ptr<SourceBuffer> expected_source, actual_source;
+    vector<Token> expected = ScanAll(filename, *GetScanKernels(kScanKernelScalar), expected_source);
+    vector<Token> actual = ScanAll(filename, kernels, actual_source);
+
+    for (size_t i = 0; i < expected.size() && i < actual.size(); ++i) {
+        const Token &e = expected[i];
+        const Token &a = actual[i];
+        if (e.type != a.type || e.lexeme != a.lexeme || e.pos.offset != a.pos.offset) {
+            cout << filename << ": " << kernels.name << " differs at token " << i
+                 << " (" << expected_source->LineNo(e.pos) << ", "
+                 << expected_source->ColNo(e.pos) << ")" << endl;
+            return false;
+        }
+    }
+
+    if (expected.size() != actual.size()) {
+        cout << filename << ": " << kernels.name << " produced " << actual.size()
+             << " tokens, expected " << expected.size() << endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char const *argv[]) {
+    bool ok = true;
+
+    for (ScanKernelKind kind : {kScanKernelScalar, kScanKernelSse2, kScanKernelAvx2}) {
+        const ScanKernels *kernels = GetScanKernels(kind);
+        if (kernels == nullptr)
+            continue;
+
+        ok = CheckKernels(*kernels) && ok;
+        for (int i = 1; kind != kScanKernelScalar && i < argc; ++i) {
+            ok = CheckFile(argv[i], *kernels) && ok;
+        }
+        cout << kernels->name << ": " << (ok ? "ok" : "FAILED") << endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -22,7 +22,8 @@ int main(int argc, char const *argv[])
         cout << TokenToString(tk.type);
         if (tk.type == kIdent || tk.type == kIntLiteral || tk.type == kDoubleLiteral) 
             cout << "(" << tk.lexeme << ")";
-        cout << " -- (" << tk.pos.LineNo() << ", " << tk.pos.ColNo() << ")" << endl;
+        cout << " -- (" << scanner.Source()->LineNo(tk.pos) << ", "
+             << scanner.Source()->ColNo(tk.pos) << ")" << endl;
     }
     return 0;
 }
@@ -0,0 +1,41 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads used when none is given, one per hardware thread.
+unsigned DefaultThreadCount();
+
+// A fixed set of worker threads running submitted tasks in FIFO order.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned num_threads = DefaultThreadCount());
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    unsigned Size() const { return workers_.size(); }
+    void Submit(std::function<void()> task);
+
+    // Block until every submitted task has finished.
+    void Wait();
+
+private:
+    void WorkerLoop();
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable task_ready_;
+    std::condition_variable all_done_;
+    size_t unfinished_ = 0;
+    bool stopping_ = false;
+};
+
+#endif // THREAD_POOL_H_